@@ -0,0 +1,373 @@
+// Host benchmarks for the signal path: ADC code -> current conversion,
+// the fixed-point DSP chain, CSV / SWVB serialization and peak / concentration extraction. A recorded
+// voltammogram is replayed at 100 to 100k points and each stage reports
+// ns/point and the heap it allocates per pass.
+//
+//   pio run -e bench && .pio/build/bench/program [trace.csv] [minMs]
+//
+// trace.csv defaults to ../Calibration/replicated_trace.csv (columns
+// "Potential (V),Current (µA)"); each stage runs for at least minMs (200).
+// Sweeps longer than SWEEP_MAX_POINTS are replayed as consecutive sweeps.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <new>
+#include <vector>
+#include "../device/voltammogram.h"
+#include "../device/sweep_plan.h"
+#include "../device/peak_analysis.h"
+#include "../device/dsp_chain.h"
+
+//────────────────────────────────────────────────────────────
+// Heap accounting
+//────────────────────────────────────────────────────────────
+
+// malloc and friends are wrapped at link time (-Wl,--wrap=...), so calls
+// from the firmware sources are counted; operator new is routed through them.
+static size_t allocBytes = 0;
+static size_t allocCount = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+void __real_free(void* p);
+
+void* __wrap_malloc(size_t size) {
+    allocBytes += size;
+    allocCount++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    allocBytes += n * size;
+    allocCount++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+    allocBytes += size;
+    allocCount++;
+    return __real_realloc(p, size);
+}
+
+void __wrap_free(void* p) {
+    __real_free(p);
+}
+}
+
+void* operator new(size_t size) {
+    void* p = malloc(size);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+//────────────────────────────────────────────────────────────
+// Trace replay
+//────────────────────────────────────────────────────────────
+
+// Board calibration defaults (pstat.cpp).
+static const float a_coeff = -146.63;
+static const float b_coeff = 7.64;
+static const int16_t pulseAmp = 25;
+static const uint32_t halfPeriodUs = 50000;
+
+struct TracePoint {
+    float mV;
+    float currentUa;
+};
+
+struct Replay {
+    std::vector<SweepBuffer> sweeps;
+    std::vector<SweepPlan> plans;
+    uint32_t numPoints;
+};
+
+static bool loadTrace(const char* path, std::vector<TracePoint>& trace) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+    char line[128];
+    if (fgets(line, sizeof(line), file) == NULL) {   // header
+        fclose(file);
+        return false;
+    }
+    float v, i;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "%f,%f", &v, &i) == 2)
+            trace.push_back({v * 1000.0f, i});
+    }
+    fclose(file);
+    return trace.size() >= 2;
+}
+
+// Linear interpolation of the trace current at fractional index u.
+static float traceCurrentAt(const std::vector<TracePoint>& trace, float u) {
+    size_t k = (size_t)u;
+    if (k >= trace.size() - 1)
+        return trace.back().currentUa;
+    float f = u - k;
+    return trace[k].currentUa * (1 - f) + trace[k + 1].currentUa * f;
+}
+
+// Largest TIA gain index that keeps the whole trace inside the ADC range.
+static uint8_t pickGain(const std::vector<TracePoint>& trace) {
+    float lo = trace[0].currentUa, hi = trace[0].currentUa;
+    for (const TracePoint& p : trace) {
+        lo = fminf(lo, p.currentUa);
+        hi = fmaxf(hi, p.currentUa);
+    }
+    for (uint8_t gain = 7; gain > 1; gain--) {
+        if (currentToAdc(hi, 3300, gain, a_coeff, b_coeff) < 4095 &&
+            currentToAdc(lo, 1500, gain, a_coeff, b_coeff) > 0)
+            return gain;
+    }
+    return 1;
+}
+
+// One sweep of n points resampled from the trace. The forward half-period
+// carries the trace current and the reverse one zero, so the net current
+// of each point is the trace value.
+static bool buildReplaySweep(const std::vector<TracePoint>& trace, uint16_t n, uint8_t gain,
+                             SweepBuffer& sweep, SweepPlan& plan) {
+    float span = trace.back().mV - trace.front().mV;
+    int16_t stepV = (int16_t)lroundf(span / (n > 1 ? n - 1 : 1));
+    if (stepV == 0)
+        stepV = span < 0 ? -1 : 1;
+    int16_t startV = (int16_t)lroundf(trace.front().mV);
+    if (!buildSweepPlan(plan, startV, startV + (n - 1) * stepV, pulseAmp, stepV, SWEEP_MAX_POINTS))
+        return false;
+
+    sweep = SweepBuffer();
+    sweep.samples = (SweepSample*)malloc(n * sizeof(SweepSample));
+    if (sweep.samples == NULL)
+        return false;
+    sweep.numPoints = n;
+    sweep.capacity = n;
+    sweep.gain = gain;
+    sweep.startV = plan.startV;
+    sweep.stepV = plan.stepV;
+    sweep.pulseAmp = pulseAmp;
+    sweep.halfPeriodUs = halfPeriodUs;
+    sweep.firstPointUs = 2 * halfPeriodUs;
+    sweep.aCoeff = a_coeff;
+    sweep.bCoeff = b_coeff;
+
+    for (uint16_t j = 0; j < n; j++) {
+        float u = (n > 1) ? (float)j * (trace.size() - 1) / (n - 1) : 0;
+        SweepSample& s = sweep.samples[j];
+        s.step = j;
+        s.adcForward = currentToAdc(traceCurrentAt(trace, u), plan.pulses[2 * j].dacVout,
+                                    gain, a_coeff, b_coeff);
+        s.adcReverse = currentToAdc(0, plan.pulses[2 * j + 1].dacVout, gain, a_coeff, b_coeff);
+        s.jitterUs = (int16_t)((j * 7) % 23 - 11);   // deterministic, realistic jitter
+        s.gain = gain;
+    }
+    return true;
+}
+
+static bool buildReplay(const std::vector<TracePoint>& trace, uint32_t numPoints, uint8_t gain,
+                        Replay& replay) {
+    replay.numPoints = numPoints;
+    for (uint32_t done = 0; done < numPoints;) {
+        uint32_t remaining = numPoints - done;
+        uint16_t n = remaining > SWEEP_MAX_POINTS ? SWEEP_MAX_POINTS : (uint16_t)remaining;
+        SweepBuffer sweep;
+        SweepPlan plan;
+        if (!buildReplaySweep(trace, n, gain, sweep, plan))
+            return false;
+        replay.sweeps.push_back(sweep);
+        replay.plans.push_back(plan);
+        done += n;
+    }
+    return true;
+}
+
+static void freeReplay(Replay& replay) {
+    for (SweepBuffer& s : replay.sweeps)
+        free(s.samples);
+    for (SweepPlan& p : replay.plans)
+        freeSweepPlan(p);
+}
+
+//────────────────────────────────────────────────────────────
+// Stages
+//────────────────────────────────────────────────────────────
+
+static volatile double sink;
+
+// The conversion biasAndSample() / saveVoltammogram() do per point, with the
+// DAC outputs taken from the sweep plan.
+static void stageAdcToCurrent(const Replay& replay) {
+    double acc = 0;
+    for (size_t k = 0; k < replay.sweeps.size(); k++) {
+        const SweepBuffer& sweep = replay.sweeps[k];
+        const PulseSetting* pulses = replay.plans[k].pulses;
+        for (uint16_t i = 0; i < sweep.numPoints; i++) {
+            const SweepSample& s = sweep.samples[i];
+            acc += adcToCurrent(s.adcForward, pulses[2 * i].dacVout, sweep.gain, sweep.aCoeff, sweep.bCoeff) -
+                   adcToCurrent(s.adcReverse, pulses[2 * i + 1].dacVout, sweep.gain, sweep.aCoeff, sweep.bCoeff);
+        }
+    }
+    sink = acc;
+}
+
+// The same conversion in fixed point, as saveVoltammogram() does it.
+static void stageFixedCurrent(const Replay& replay) {
+    int64_t acc = 0;
+    for (size_t k = 0; k < replay.sweeps.size(); k++) {
+        const SweepBuffer& sweep = replay.sweeps[k];
+        const PulseSetting* pulses = replay.plans[k].pulses;
+        DspScale scale;
+        dspScaleBegin(scale, sweep.gain, sweep.bCoeff);
+        for (uint16_t i = 0; i < sweep.numPoints; i++) {
+            const SweepSample& s = sweep.samples[i];
+            acc += dspNetCurrentPa(scale, s.adcForward, pulses[2 * i].dacVout, s.adcReverse,
+                                   pulses[2 * i + 1].dacVout);
+        }
+    }
+    sink = acc;
+}
+
+// Median 5, Savitzky-Golay 7 and a linear baseline over the converted
+// currents, streaming as in runSWV().
+static void stageDsp(const Replay& replay) {
+    static int32_t currents[SWEEP_MAX_POINTS];
+    const DspConfig config = {5, DSP_SMOOTH_SAVITZKY_GOLAY, 7, DSP_BASELINE_LINEAR, 8};
+    int64_t acc = 0;
+    for (size_t k = 0; k < replay.sweeps.size(); k++) {
+        const SweepBuffer& sweep = replay.sweeps[k];
+        const PulseSetting* pulses = replay.plans[k].pulses;
+        DspScale scale;
+        DspChain chain;
+        dspScaleBegin(scale, sweep.gain, sweep.bCoeff);
+        dspBegin(chain, config);
+        uint16_t n = 0;
+        for (uint16_t i = 0; i < sweep.numPoints; i++) {
+            const SweepSample& s = sweep.samples[i];
+            int32_t x = dspNetCurrentPa(scale, s.adcForward, pulses[2 * i].dacVout, s.adcReverse,
+                                        pulses[2 * i + 1].dacVout);
+            if (dspPush(chain, x, currents[n]))
+                n++;
+        }
+        n += dspFlush(chain, &currents[n]);
+        dspRemoveBaseline(config, sweep, currents, n);
+        acc += currents[n / 2];
+    }
+    sink = acc;
+}
+
+// Conversion on the export path, which re-resolves the pulse settings.
+static void stagePointCurrent(const Replay& replay) {
+    double acc = 0;
+    for (const SweepBuffer& sweep : replay.sweeps) {
+        for (uint16_t i = 0; i < sweep.numPoints; i++)
+            acc += getSweepPointCurrent(sweep, i);
+    }
+    sink = acc;
+}
+
+// The row loop of writeVoltammogramToFile() into a memory sink.
+static void stageSerialize(const Replay& replay, VoltammogramFormat format) {
+    size_t bytes = 0;
+    char line[VOLTAMMOGRAM_ROW_MAX_LEN];
+    for (const SweepBuffer& sweep : replay.sweeps) {
+        VoltammogramCursor cursor = {0, 0};
+        while (cursor.row <= sweep.numPoints) {
+            size_t n = formatVoltammogramRow(sweep, format, cursor, line, sizeof(line));
+            bytes += n + (uint8_t)line[0];
+        }
+    }
+    sink = bytes;
+}
+
+static void stageCsv(const Replay& replay) {
+    stageSerialize(replay, VOLTAMMOGRAM_CSV);
+}
+
+static void stageBinary(const Replay& replay) {
+    stageSerialize(replay, VOLTAMMOGRAM_BINARY);
+}
+
+// The on-line analysis runSWV() feeds point by point, run over each sweep.
+static void stagePeak(const Replay& replay) {
+    double acc = 0;
+    for (const SweepBuffer& sweep : replay.sweeps) {
+        PeakSummary summary;
+        analyzeSweep(sweep, PEAK_CALIBRATION_DEFAULT, summary);
+        acc += summary.concentration + summary.peakUa;
+    }
+    sink = acc;
+}
+
+struct Stage {
+    const char* name;
+    void (*run)(const Replay& replay);
+};
+
+static const Stage stages[] = {
+    {"adc_to_current", stageAdcToCurrent},
+    {"fixed_current",  stageFixedCurrent},
+    {"dsp",            stageDsp},
+    {"point_current",  stagePointCurrent},
+    {"csv",            stageCsv},
+    {"swvb",           stageBinary},
+    {"peak",           stagePeak},
+};
+
+static void runStage(const Stage& stage, const Replay& replay, double minMs) {
+    stage.run(replay);   // warm up
+    size_t bytes0 = allocBytes, count0 = allocCount;
+    uint32_t reps = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    double elapsedNs;
+    do {
+        stage.run(replay);
+        reps++;
+        elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    } while (elapsedNs < minMs * 1e6);
+
+    printf("%-16s %8u %10.1f %12.0f %10.1f\n", stage.name, replay.numPoints,
+           elapsedNs / ((double)reps * replay.numPoints),
+           (double)(allocBytes - bytes0) / reps, (double)(allocCount - count0) / reps);
+}
+
+int main(int argc, char** argv) {
+    const char* tracePath = argc > 1 ? argv[1] : "../Calibration/replicated_trace.csv";
+    double minMs = argc > 2 ? atof(argv[2]) : 200;
+
+    std::vector<TracePoint> trace;
+    if (!loadTrace(tracePath, trace)) {
+        fprintf(stderr, "cannot read trace %s\n", tracePath);
+        return 1;
+    }
+    uint8_t gain = pickGain(trace);
+    printf("trace: %s (%u points), gain index %u\n", tracePath, (unsigned)trace.size(), gain);
+    printf("%-16s %8s %10s %12s %10s\n", "stage", "points", "ns/point", "bytes/pass", "allocs/pass");
+
+    static const uint32_t sizes[] = {100, 1000, 10000, 100000};
+    for (uint32_t numPoints : sizes) {
+        Replay replay;
+        if (!buildReplay(trace, numPoints, gain, replay)) {
+            fprintf(stderr, "cannot build a %u point replay\n", numPoints);
+            freeReplay(replay);
+            return 1;
+        }
+        for (const Stage& stage : stages)
+            runStage(stage, replay, minMs);
+        freeReplay(replay);
+    }
+    return 0;
+}
@@ -1,6 +1,6 @@
 #include "device.h"
 #include <Wire.h>
-#include <SPIFFS.h>
+#include <LittleFS.h>
 #include "LMP91000.h"  // Include your LMP91000 driver header
 #include <WiFi.h>
 #include "soc/soc.h"          // Required for WRITE_PERI_REG
@@ -17,12 +17,10 @@ static const int MENB   = 5;    // Pin to enable the potentiostat
 // Internal (static) initialization functions
 //--------------------------------------------------------//
 
-// Initialize the UART for debugging.
+// Initialize the UART for debugging. The ESP32 UART is ready as soon as it
+// is begun, so there is nothing to wait for.
 static void initUART() {
     Serial.begin(115200);
-    while (!Serial) {
-        delay(10);
-    }
     if (debugLevel) {
         Serial.println("UART initialized.");
     }
@@ -37,8 +35,26 @@ static void initLEDs() {
     }
 }
 
-// Initialize WIFI AP.
-static void initWiFiAP() {
+// Mount LittleFS (for file storage) on the "spiffs" data partition. It is
+// only formatted if it cannot be mounted.
+static void initStorage() {
+    if (!LittleFS.begin(true)) {
+        if (debugLevel) {
+            Serial.println("Error mounting LittleFS");
+        }
+    } else {
+        if (debugLevel) {
+            Serial.println("LittleFS mounted successfully.");
+        }
+    }
+}
+
+
+//--------------------------------------------------------//
+// Public functions (as declared in device.h)
+//--------------------------------------------------------//
+
+void startWiFiAP() {
     // Set a fixed IP configuration for the ESP32 AP.
     IPAddress local_IP(192, 168, 4, 1);
     IPAddress gateway(192, 168, 4, 1);
@@ -48,7 +64,6 @@ static void initWiFiAP() {
     // Set the ESP32 into Access Point mode and start the AP.
     WiFi.mode(WIFI_AP);
     WiFi.softAP("metallyze_sensor", "safewater");
-    delay(500); // Give the AP time to initialize
 
     if (debugLevel) {
         Serial.println("WiFi Access Point started successfully.");
@@ -57,10 +72,10 @@ static void initWiFiAP() {
     }
 }
 
-
-//--------------------------------------------------------//
-// Public functions (as declared in device.h)
-//--------------------------------------------------------//
+void stopWiFi() {
+    WiFi.softAPdisconnect(true);
+    WiFi.mode(WIFI_OFF);
+}
 
 void initHardware() {
     // Disable brownout detector to avoid resets during WiFi startup.
@@ -74,16 +89,7 @@ void initHardware() {
         Serial.println("Starting hardware initialization...");
     }
 
-    // Initialize SPIFFS (for file storage)
-    if (!SPIFFS.begin(true)) {
-        if (debugLevel) {
-            Serial.println("Error mounting SPIFFS");
-        }
-    } else {
-        if (debugLevel) {
-            Serial.println("SPIFFS mounted successfully.");
-        }
-    }
+    initStorage();
 
     // Initialize the I2C bus (used by the potentiostat and other I2C devices)
     Wire.begin();
@@ -95,13 +101,23 @@ void initHardware() {
     initLEDs();
 
     // Initialize WiFi in AP mode.
-    initWiFiAP();
+    startWiFiAP();
+    delay(500); // Give the AP time to initialize
 
     if (debugLevel) {
         Serial.println("All hardware initialized.");
     }
 }
 
+void initHardwareForMeasurement() {
+    WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0);
+    Serial.begin(115200);
+    initStorage();
+    Wire.begin();
+    pinMode(LEDPIN, OUTPUT);
+    digitalWrite(LEDPIN, LOW);
+}
+
 void toggleLED() {
     int currentState = digitalRead(LEDPIN);
     digitalWrite(LEDPIN, !currentState);
@@ -127,7 +143,19 @@ void setDebugLevel(bool on) {
     }
 }
 
+bool getDebugLevel() {
+    return debugLevel;
+}
+
 // New public helper function that returns free heap memory.
 unsigned long getFreeHeap() {
     return ESP.getFreeHeap();
 }
+
+unsigned long getMinFreeHeap() {
+    return ESP.getMinFreeHeap();
+}
+
+unsigned long getLargestFreeBlock() {
+    return ESP.getMaxAllocHeap();
+}
@@ -6,14 +6,27 @@
 // Initialization functions
 void initHardware();
 
+// Duty-cycled boot: UART, storage, I2C and LED only, without debug output;
+// WiFi is left off until startWiFiAP().
+void initHardwareForMeasurement();
+
+// Access point at 192.168.4.1; returns once it is started.
+void startWiFiAP();
+void stopWiFi();
+
 // LED control functions
 void toggleLED();
 void setLED(bool on);
 
-// Debug level control function
+// Debug level control functions
 void setDebugLevel(bool on);
+bool getDebugLevel();
 
 // New helper function to get free heap memory (RAM)
 unsigned long getFreeHeap();
 
+// Lowest free heap since boot, and the largest block malloc() can return now.
+unsigned long getMinFreeHeap();
+unsigned long getLargestFreeBlock();
+
 #endif // DEVICE_H
@@ -0,0 +1,236 @@
+#include "dsp_chain.h"
+#include <math.h>
+#include "../hal/lmp91000_tables.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+static const int32_t q15One = 1 << 15;
+
+// Quadratic Savitzky-Golay smoothing kernels (integer weights / norm) for 5,
+// 7 and 9 points.
+struct SavitzkyGolayKernel {
+    int16_t norm;
+    int16_t weights[DSP_MAX_WINDOW];
+};
+
+static const SavitzkyGolayKernel savitzkyGolay[] = {
+    {35,  {-3, 12, 17, 12, -3}},
+    {21,  {-2, 3, 6, 7, 6, 3, -2}},
+    {231, {-21, 14, 39, 54, 59, 54, 39, 14, -21}},
+};
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+// Q15 kernel from integer weights; the rounding error goes to the centre tap
+// so the kernel passes DC exactly.
+static void buildKernel(int16_t* kernel, const int16_t* weights, uint8_t len, int32_t norm) {
+    int32_t sum = 0;
+    for (uint8_t k = 0; k < len; k++) {
+        int32_t w = weights[k] * q15One;
+        kernel[k] = (int16_t)((w + (w >= 0 ? norm / 2 : -norm / 2)) / norm);
+        sum += kernel[k];
+    }
+    kernel[len / 2] += (int16_t)(q15One - sum);
+}
+
+static void windowBegin(DspWindow& w, uint8_t len) {
+    w = DspWindow();
+    w.len = len;
+}
+
+// Adds a value; the first one also fills the left padding. Returns true when
+// the window is full, i.e. centred on the next output.
+static bool windowPush(DspWindow& w, int32_t x) {
+    uint8_t copies = w.count == 0 ? w.len / 2 + 1 : 1;
+    for (uint8_t i = 0; i < copies; i++) {
+        w.ring[w.head] = x;
+        w.head = w.head + 1 == w.len ? 0 : w.head + 1;
+        if (w.count < w.len)
+            w.count++;
+    }
+    w.last = x;
+    return w.count == w.len;
+}
+
+static int32_t windowMedian(const DspWindow& w) {
+    int32_t v[DSP_MAX_WINDOW];
+    for (uint8_t i = 0; i < w.len; i++) {
+        int32_t x = w.ring[i];
+        uint8_t j = i;
+        for (; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+    return v[w.len / 2];
+}
+
+// Kernel over the full window, oldest value first.
+static int32_t windowSmooth(const DspWindow& w, const int16_t* kernel) {
+    int64_t acc = 0;
+    uint8_t i = w.head;
+    for (uint8_t k = 0; k < w.len; k++) {
+        acc += (int64_t)kernel[k] * w.ring[i];
+        i = i + 1 == w.len ? 0 : i + 1;
+    }
+    return (int32_t)((acc + (1 << 14)) >> 15);
+}
+
+static bool medianOn(const DspChain& chain) {
+    return chain.config.medianWindow > 1;
+}
+
+static bool smoothOn(const DspChain& chain) {
+    return chain.config.smoothing != DSP_SMOOTH_NONE;
+}
+
+// Smoothing stage; passes values through when it is off.
+static bool smoothPush(DspChain& chain, int32_t x, int32_t& out) {
+    if (!smoothOn(chain)) {
+        out = x;
+        return true;
+    }
+    if (!windowPush(chain.smooth, x))
+        return false;
+    out = windowSmooth(chain.smooth, chain.kernel);
+    return true;
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+const char* dspConfigValidate(const DspConfig& config) {
+    if (config.medianWindow > 1 && config.medianWindow != 3 && config.medianWindow != 5)
+        return "median window must be 0, 3 or 5";
+    if (config.smoothing == DSP_SMOOTH_MOVING_AVERAGE &&
+        (config.smoothWindow < 3 || config.smoothWindow > DSP_MAX_WINDOW || config.smoothWindow % 2 == 0))
+        return "moving average window must be 3, 5, 7 or 9";
+    if (config.smoothing == DSP_SMOOTH_SAVITZKY_GOLAY &&
+        config.smoothWindow != 5 && config.smoothWindow != 7 && config.smoothWindow != 9)
+        return "Savitzky-Golay window must be 5, 7 or 9";
+    if (config.smoothing > DSP_SMOOTH_SAVITZKY_GOLAY)
+        return "unknown smoothing";
+    if (config.baseline > DSP_BASELINE_QUADRATIC)
+        return "unknown baseline";
+    if (config.baseline != DSP_BASELINE_NONE && config.edgePoints < 2)
+        return "baseline needs at least 2 edge points";
+    return NULL;
+}
+
+bool dspConfigActive(const DspConfig& config) {
+    return config.medianWindow > 1 || config.smoothing != DSP_SMOOTH_NONE ||
+           config.baseline != DSP_BASELINE_NONE;
+}
+
+void dspScaleBegin(DspScale& scale, uint8_t gain, float bCoeff) {
+    // adcToCurrent(): (v1 - dacVout / 2) mV across the TIA, with
+    // v1 = (adc - a) * 3300 / 255 / (2 b) mV. The offset a cancels in the
+    // forward - reverse difference.
+    double tia = (gain == 0) ? 1e6 : TIA_GAIN[gain - 1];
+    double adcPa = (3300.0 / 255.0) / (2.0 * bCoeff) * 1e9 / tia;
+    double dacPa = 0.5 * 1e9 / tia;
+    double adcQ12 = adcPa * 4096.0;
+    double dacQ12 = dacPa * 4096.0;
+    scale.adcQ12 = (int32_t)fmin(lround(adcQ12), INT32_MAX);
+    scale.dacQ12 = (int32_t)fmin(lround(dacQ12), INT32_MAX);
+}
+
+void dspBegin(DspChain& chain, const DspConfig& config) {
+    chain.config = config;
+    windowBegin(chain.median, config.medianWindow > 1 ? config.medianWindow : 1);
+    windowBegin(chain.smooth, config.smoothing != DSP_SMOOTH_NONE ? config.smoothWindow : 1);
+
+    if (config.smoothing == DSP_SMOOTH_MOVING_AVERAGE) {
+        int16_t ones[DSP_MAX_WINDOW] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+        buildKernel(chain.kernel, ones, config.smoothWindow, config.smoothWindow);
+    } else if (config.smoothing == DSP_SMOOTH_SAVITZKY_GOLAY) {
+        const SavitzkyGolayKernel& sg = savitzkyGolay[(config.smoothWindow - 5) / 2];
+        buildKernel(chain.kernel, sg.weights, config.smoothWindow, sg.norm);
+    }
+}
+
+bool dspPush(DspChain& chain, int32_t currentPa, int32_t& out) {
+    if (!medianOn(chain))
+        return smoothPush(chain, currentPa, out);
+    if (!windowPush(chain.median, currentPa))
+        return false;
+    return smoothPush(chain, windowMedian(chain.median), out);
+}
+
+uint8_t dspFlush(DspChain& chain, int32_t* out) {
+    uint8_t n = 0;
+    if (medianOn(chain) && chain.median.count > 0) {
+        for (uint8_t i = 0; i < chain.median.len / 2; i++) {
+            if (windowPush(chain.median, chain.median.last) &&
+                smoothPush(chain, windowMedian(chain.median), out[n]))
+                n++;
+        }
+    }
+    if (smoothOn(chain) && chain.smooth.count > 0) {
+        for (uint8_t i = 0; i < chain.smooth.len / 2; i++) {
+            if (windowPush(chain.smooth, chain.smooth.last))
+                out[n++] = windowSmooth(chain.smooth, chain.kernel);
+        }
+    }
+    return n;
+}
+
+void dspRemoveBaseline(const DspConfig& config, const SweepBuffer& sweep, int32_t* values, uint16_t n) {
+    if (config.baseline == DSP_BASELINE_NONE || n == 0)
+        return;
+    uint8_t degree = config.baseline == DSP_BASELINE_QUADRATIC ? 2 : 1;
+    uint16_t edge = config.edgePoints < n / 2 ? config.edgePoints : n / 2;
+    if (2 * edge < degree + 1)
+        return;
+
+    // Least squares in x = potential - centre (mV); once per sweep, so the
+    // normal equations are solved in double.
+    int32_t centre = (sweepPointV(sweep, 0) + sweepPointV(sweep, n - 1)) / 2;
+    double s[5] = {0}, t[3] = {0};
+    for (uint16_t k = 0; k < 2 * edge; k++) {
+        uint16_t i = k < edge ? k : n - 2 * edge + k;
+        double x = sweepPointV(sweep, i) - centre;
+        double y = values[i];
+        double xp = 1;
+        for (uint8_t p = 0; p <= 4; p++) {
+            s[p] += xp;
+            if (p <= 2)
+                t[p] += y * xp;
+            xp *= x;
+        }
+    }
+    double c0, c1, c2 = 0;
+    if (degree == 1) {
+        double det = s[0] * s[2] - s[1] * s[1];
+        if (det == 0)
+            return;
+        c0 = (t[0] * s[2] - t[1] * s[1]) / det;
+        c1 = (s[0] * t[1] - s[1] * t[0]) / det;
+    } else {
+        // Cramer's rule on [s0 s1 s2; s1 s2 s3; s2 s3 s4] c = t.
+        double det = s[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (s[1] * s[4] - s[3] * s[2]) +
+                     s[2] * (s[1] * s[3] - s[2] * s[2]);
+        if (det == 0)
+            return;
+        c0 = (t[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (t[1] * s[4] - s[3] * t[2]) +
+              s[2] * (t[1] * s[3] - s[2] * t[2])) / det;
+        c1 = (s[0] * (t[1] * s[4] - s[3] * t[2]) - t[0] * (s[1] * s[4] - s[3] * s[2]) +
+              s[2] * (s[1] * t[2] - t[1] * s[2])) / det;
+        c2 = (s[0] * (s[2] * t[2] - t[1] * s[3]) - s[1] * (s[1] * t[2] - t[1] * s[2]) +
+              t[0] * (s[1] * s[3] - s[2] * s[2])) / det;
+    }
+
+    // Evaluated per point in fixed point: c1 and c2 in Q16.
+    int64_t b0 = llround(c0);
+    int64_t b1 = llround(c1 * 65536.0);
+    int64_t b2 = llround(c2 * 65536.0);
+    for (uint16_t i = 0; i < n; i++) {
+        int64_t x = sweepPointV(sweep, i) - centre;
+        int64_t baseline = b0 + ((b1 * x + b2 * x * x) >> 16);
+        values[i] = (int32_t)(values[i] - baseline);
+    }
+}
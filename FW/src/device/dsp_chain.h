@@ -0,0 +1,102 @@
+#ifndef DSP_CHAIN_H
+#define DSP_CHAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sweep_buffer.h"
+
+// Streaming noise reduction of SWV net currents in fixed point, cheap enough
+// to run per point inside the sampling loop. Currents are int32 pA (the SWVB
+// current LSB); filter kernels are Q15 and products accumulate in 64 bits, so
+// there is no floating point and no allocation per point.
+//
+// Stages, each optional, in this order:
+//   median     spike rejection over 3 or 5 points
+//   smoothing  moving average (3..9 points) or quadratic Savitzky-Golay
+//              (5, 7 or 9 points)
+//   baseline   linear or quadratic least-squares fit through the first and
+//              last edgePoints points, subtracted once the sweep is complete
+// Windows are centred and the ends are padded by repeating the first and
+// last value, so there is one output per input, delayed while streaming by
+// the half-widths of the windows.
+
+const uint8_t DSP_MAX_WINDOW = 9;
+
+enum DspSmoothing : uint8_t {
+    DSP_SMOOTH_NONE,
+    DSP_SMOOTH_MOVING_AVERAGE,
+    DSP_SMOOTH_SAVITZKY_GOLAY
+};
+
+enum DspBaseline : uint8_t {
+    DSP_BASELINE_NONE,
+    DSP_BASELINE_LINEAR,
+    DSP_BASELINE_QUADRATIC
+};
+
+struct DspConfig {
+    uint8_t medianWindow;   // 0 = off, 3 or 5
+    uint8_t smoothing;      // DspSmoothing
+    uint8_t smoothWindow;   // odd, see above
+    uint8_t baseline;       // DspBaseline
+    uint8_t edgePoints;     // points at each end for the baseline fit
+};
+
+const DspConfig DSP_CONFIG_OFF = {0, DSP_SMOOTH_NONE, 0, DSP_BASELINE_NONE, 0};
+
+// Checks a configuration; returns NULL if it can run, otherwise the reason.
+const char* dspConfigValidate(const DspConfig& config);
+
+// True if any stage is on.
+bool dspConfigActive(const DspConfig& config);
+
+// Net current of a point from its raw codes, set up once per sweep for the
+// gain and the ADC calibration slope b (the offset a cancels in the forward -
+// reverse difference): pA per ADC code and per DAC mV, Q12.
+struct DspScale {
+    int32_t adcQ12;
+    int32_t dacQ12;
+};
+
+void dspScaleBegin(DspScale& scale, uint8_t gain, float bCoeff);
+
+// Same value as adcToCurrent(forward) - adcToCurrent(reverse), in pA.
+inline int32_t dspNetCurrentPa(const DspScale& scale, uint16_t adcForward, uint16_t dacForward,
+                               uint16_t adcReverse, uint16_t dacReverse) {
+    int64_t acc = (int64_t)((int32_t)adcForward - adcReverse) * scale.adcQ12 -
+                  (int64_t)((int32_t)dacForward - dacReverse) * scale.dacQ12;
+    return (int32_t)((acc + 2048) >> 12);
+}
+
+// Centred window of one stage.
+struct DspWindow {
+    int32_t ring[DSP_MAX_WINDOW];
+    uint8_t len;
+    uint8_t head;       // next slot to write, and the oldest value once full
+    uint8_t count;
+    int32_t last;       // last value pushed, for padding the end
+};
+
+struct DspChain {
+    DspConfig config;
+    int16_t kernel[DSP_MAX_WINDOW];   // Q15 smoothing kernel, sums to 1
+    DspWindow median;
+    DspWindow smooth;
+};
+
+// Starts a sweep. The configuration must have passed dspConfigValidate().
+void dspBegin(DspChain& chain, const DspConfig& config);
+
+// Feeds the next net current; writes the next filtered value to out and
+// returns true once the windows have filled.
+bool dspPush(DspChain& chain, int32_t currentPa, int32_t& out);
+
+// Ends the sweep: writes the values still held back (at most
+// DSP_MAX_WINDOW - 1) to out and returns how many.
+uint8_t dspFlush(DspChain& chain, int32_t* out);
+
+// Subtracts the baseline stage's fit from the n filtered values of a sweep
+// (potentials taken from its samples). No-op with the baseline stage off.
+void dspRemoveBaseline(const DspConfig& config, const SweepBuffer& sweep, int32_t* values, uint16_t n);
+
+#endif // DSP_CHAIN_H
@@ -0,0 +1,98 @@
+#include "duty_cycle.h"
+#include "../hal/hal.h"
+#include "../util/spsc_queue.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+static const char* dutyCycleKey = "duty";
+
+// The stored blob is the raw struct behind a header. A different size reads
+// as missing (halConfigLoad()); bump the version when DutyCycleConfig or
+// SweepJobSpec change meaning without changing size.
+struct StoredDutyCycle {
+    uint16_t version;
+    uint16_t size;
+    DutyCycleConfig config;
+};
+static const uint16_t dutyCycleVersion = 1;
+
+// Updates from the HTTP server wait here for dutyCycleSave().
+static SpscQueue<DutyCycleConfig, 4> unsaved;
+static DutyCycleConfig requested;
+static bool hasRequested = false;   // updater only
+
+HAL_RETAINED static DutyCycleState state;
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+DutyCycleConfig dutyCycleLoad() {
+    StoredDutyCycle stored;
+    if (!halConfigLoad(dutyCycleKey, &stored, sizeof(stored)) || stored.version != dutyCycleVersion ||
+        stored.size != sizeof(stored.config) || dutyCycleValidate(stored.config) != NULL)
+        return DUTY_CYCLE_DEFAULT;
+    return stored.config;
+}
+
+const char* dutyCycleValidate(const DutyCycleConfig& config) {
+    if (config.periodS < 10)
+        return "period must be at least 10 s";
+    if (config.uploadEvery == 0)
+        return "uploadEvery must be at least 1";
+    if (config.uploadWindowS == 0 || config.uploadWindowS >= config.periodS)
+        return "upload window must be positive and shorter than the period";
+    return sweepJobValidate(config.spec);
+}
+
+bool dutyCycleUpdate(const DutyCycleConfig& config) {
+    if (!unsaved.push(config))
+        return false;
+    requested = config;
+    hasRequested = true;
+    return true;
+}
+
+DutyCycleConfig dutyCycleRequested() {
+    return hasRequested ? requested : dutyCycleLoad();
+}
+
+bool dutyCycleSave() {
+    StoredDutyCycle stored = {dutyCycleVersion, sizeof(DutyCycleConfig), {}};
+    bool pending = false;
+    while (unsaved.pop(stored.config))
+        pending = true;
+    return !pending || halConfigStore(dutyCycleKey, &stored, sizeof(stored));
+}
+
+DutyCycleState& dutyCycleState() {
+    return state;
+}
+
+bool dutyCycleRecordWake(const DutyCycleConfig& config, uint32_t wakeToSampleUs) {
+    state.wakes++;
+    state.lastWakeToSampleUs = wakeToSampleUs;
+    if (wakeToSampleUs <= (uint32_t)config.wakeBudgetMs * 1000)
+        return true;
+    state.overBudget++;
+    return false;
+}
+
+bool dutyCycleSweepDone(const DutyCycleConfig& config) {
+    if (state.sweepsSinceUpload < UINT16_MAX)
+        state.sweepsSinceUpload++;
+    return state.sweepsSinceUpload >= config.uploadEvery;
+}
+
+void dutyCycleUploadDone(bool delivered) {
+    state.sweepsSinceUpload = 0;
+    if (!delivered)
+        state.failedUploads++;
+}
+
+uint64_t dutyCycleSleepUs(const DutyCycleConfig& config, int64_t awakeUs) {
+    int64_t left = (int64_t)config.periodS * 1000000 - awakeUs;
+    return left < 1000000 ? 1000000 : (uint64_t)left;
+}
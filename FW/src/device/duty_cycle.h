@@ -0,0 +1,75 @@
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sweep_jobs.h"
+
+// Duty-cycled measurement for battery deployments: every wake runs one
+// sweep of `spec`, appends it to the sweep log and goes back to deep sleep
+// until the next period. WiFi is only started every uploadEvery wakes, to
+// forward the unsent part of the log to the backends; the access point then
+// stays up for at most uploadWindowS, which is also when the device can be
+// reconfigured over HTTP. Sweeps a window fails to deliver stay in the log
+// for the next one.
+//
+// The configuration lives in the settings store, tagged with a layout
+// version; the counters below live in RTC memory and survive deep sleep but
+// not a reset.
+
+struct DutyCycleConfig {
+    bool enabled;
+    uint32_t periodS;          // wake to wake
+    uint16_t uploadEvery;      // wakes per upload window
+    uint16_t uploadWindowS;    // how long the access point stays up
+    uint16_t wakeBudgetMs;     // target time from wake to the first ADC sample
+    SweepJobSpec spec;         // the sweep run at every wake (repeat is ignored)
+};
+
+const DutyCycleConfig DUTY_CYCLE_DEFAULT = {false, 300, 6, 30, 200, SWEEP_JOB_DEFAULT};
+
+struct DutyCycleState {
+    uint32_t wakes;               // since power-on
+    uint16_t sweepsSinceUpload;
+    uint32_t lastWakeToSampleUs;  // of the latest wake
+    uint32_t overBudget;          // wakes that missed wakeBudgetMs
+    uint32_t failedUploads;       // windows that delivered nothing
+};
+
+// Loads the configuration; DUTY_CYCLE_DEFAULT if none was stored, it was
+// stored by firmware with another layout, or it is invalid.
+DutyCycleConfig dutyCycleLoad();
+
+// Checks a configuration; returns NULL if it can run, otherwise the reason.
+const char* dutyCycleValidate(const DutyCycleConfig& config);
+
+// Queues a validated configuration to be persisted by dutyCycleSave(); it
+// takes effect at the next boot. Does not block, for the HTTP handlers.
+// Returns false if too many updates are waiting.
+bool dutyCycleUpdate(const DutyCycleConfig& config);
+
+// The latest configuration passed to dutyCycleUpdate(), saved or not;
+// otherwise the stored one. Same task as dutyCycleUpdate().
+DutyCycleConfig dutyCycleRequested();
+
+// Persists the queued updates. Writes flash, so call it from a task that may
+// block; one task at a time. Returns false if a write failed.
+bool dutyCycleSave();
+
+DutyCycleState& dutyCycleState();
+
+// Records a wake whose first ADC sample came wakeToSampleUs after boot.
+// Returns false if that missed the budget.
+bool dutyCycleRecordWake(const DutyCycleConfig& config, uint32_t wakeToSampleUs);
+
+// Counts this wake's sweep; true if it is time for an upload window.
+bool dutyCycleSweepDone(const DutyCycleConfig& config);
+
+// Marks an upload window as over.
+void dutyCycleUploadDone(bool delivered);
+
+// Sleep time (µs) left in this period after being awake for awakeUs; at
+// least one second.
+uint64_t dutyCycleSleepUs(const DutyCycleConfig& config, int64_t awakeUs);
+
+#endif // DUTY_CYCLE_H
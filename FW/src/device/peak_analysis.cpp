@@ -0,0 +1,145 @@
+#include "peak_analysis.h"
+#include "voltammogram.h"
+
+//────────────────────────────────────────────────────────────
+// Static Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+// Valid concentration range, as in Web/server.py.
+static const float minConcentration = 10;
+static const float maxConcentration = 10000;
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+// Vertex of the parabola through three points, clamped to [x0, x2]. Falls
+// back to the middle point if they are collinear.
+static void parabolaVertex(float x0, float y0, float x1, float y1, float x2, float y2,
+                           float& x, float& y) {
+    float d0 = (x1 - x0) * (y1 - y2);
+    float d2 = (x1 - x2) * (y1 - y0);
+    float denom = d0 - d2;
+    if (denom == 0) {
+        x = x1;
+        y = y1;
+        return;
+    }
+    x = x1 - 0.5f * ((x1 - x0) * d0 - (x1 - x2) * d2) / denom;
+    float lo = x0 < x2 ? x0 : x2;
+    float hi = x0 < x2 ? x2 : x0;
+    if (x < lo)
+        x = lo;
+    else if (x > hi)
+        x = hi;
+    // Lagrange form evaluated at the vertex.
+    y = y0 * (x - x1) * (x - x2) / ((x0 - x1) * (x0 - x2)) +
+        y1 * (x - x0) * (x - x2) / ((x1 - x0) * (x1 - x2)) +
+        y2 * (x - x0) * (x - x1) / ((x2 - x0) * (x2 - x1));
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+void peakTrackerBegin(PeakTracker& tracker, uint16_t expectedPoints) {
+    tracker = PeakTracker();
+    uint16_t edge = expectedPoints / 10;
+    tracker.edgeLen = edge < 1 ? 1 : (edge > PEAK_EDGE_MAX_POINTS ? PEAK_EDGE_MAX_POINTS : edge);
+}
+
+void peakTrackerAdd(PeakTracker& tracker, int16_t voltage, float currentUa) {
+    PeakTracker& t = tracker;
+    if (t.rightPending) {
+        t.rightV = voltage;
+        t.right = currentUa;
+        t.rightPending = false;
+    }
+    if (t.count == 0 || currentUa > t.peak) {
+        t.peakIndex = t.count;
+        t.peakV = voltage;
+        t.peak = currentUa;
+        t.leftV = t.prevV;
+        t.left = t.prev;
+        t.rightPending = true;
+    }
+
+    if (t.count < t.edgeLen) {
+        t.headV += voltage;
+        t.headI += currentUa;
+    }
+    uint8_t slot = t.count % t.edgeLen;
+    t.tailV[slot] = voltage;
+    t.tailI[slot] = currentUa;
+
+    t.prevV = voltage;
+    t.prev = currentUa;
+    t.count++;
+}
+
+void peakTrackerFinish(const PeakTracker& tracker, const PeakCalibration& calibration,
+                       PeakSummary& summary) {
+    const PeakTracker& t = tracker;
+    summary = PeakSummary();
+    summary.flags = t.flags;
+    if (t.count == 0) {
+        summary.flags |= PEAK_FLAG_SHORT | PEAK_FLAG_NO_PEAK;
+        return;
+    }
+
+    summary.peakIndex = t.peakIndex;
+    summary.peakMv = t.peakV;
+    summary.peakUa = t.peak;
+    bool edge = t.peakIndex == 0 || t.rightPending;
+    if (edge)
+        summary.flags |= PEAK_FLAG_EDGE;
+    else
+        parabolaVertex(t.leftV, t.left, t.peakV, t.peak, t.rightV, t.right,
+                       summary.peakMv, summary.peakUa);
+
+    // Baseline through the means of the first and last edgeLen points; needs
+    // both ends clear of each other.
+    if (t.count >= 2 * t.edgeLen + 1) {
+        float tailV = 0, tailI = 0;
+        for (uint8_t i = 0; i < t.edgeLen; i++) {
+            tailV += t.tailV[i];
+            tailI += t.tailI[i];
+        }
+        float v0 = t.headV / t.edgeLen, i0 = t.headI / t.edgeLen;
+        float v1 = tailV / t.edgeLen, i1 = tailI / t.edgeLen;
+        summary.baselineUa = (v1 == v0) ? i0 : i0 + (i1 - i0) * (summary.peakMv - v0) / (v1 - v0);
+    } else {
+        summary.flags |= PEAK_FLAG_SHORT;
+    }
+    summary.heightUa = summary.peakUa - summary.baselineUa;
+    if (summary.heightUa <= 0)
+        summary.flags |= PEAK_FLAG_NO_PEAK;
+
+    float y = calibration.baselineCorrected ? summary.heightUa : summary.peakUa;
+    float raw = (y - calibration.intercept) / calibration.slope;
+    summary.concentration = peakToConcentration(y, calibration);
+    if (raw < minConcentration || raw > maxConcentration)
+        summary.flags |= PEAK_FLAG_CLAMPED;
+}
+
+void analyzeSweep(const SweepBuffer& sweep, const PeakCalibration& calibration,
+                  PeakSummary& summary) {
+    PeakTracker tracker;
+    peakTrackerBegin(tracker, sweep.numPoints);
+    for (uint16_t i = 0; i < sweep.numPoints; i++) {
+        const SweepSample& s = sweep.samples[i];
+        if (s.adcForward == 0 || s.adcForward >= 4095 || s.adcReverse == 0 || s.adcReverse >= 4095)
+            peakTrackerFlag(tracker, PEAK_FLAG_SATURATED);
+        peakTrackerAdd(tracker, sweepPointV(sweep, i), getSweepPointCurrent(sweep, i));
+    }
+    peakTrackerFinish(tracker, calibration, summary);
+}
+
+float peakToConcentration(float currentUa, const PeakCalibration& calibration) {
+    float concentration = (currentUa - calibration.intercept) / calibration.slope;
+    if (concentration < minConcentration)
+        return 0;
+    if (concentration > maxConcentration)
+        return maxConcentration;
+    return concentration;
+}
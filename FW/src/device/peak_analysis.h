@@ -0,0 +1,67 @@
+#ifndef PEAK_ANALYSIS_H
+#define PEAK_ANALYSIS_H
+
+#include <stdint.h>
+#include "sweep_buffer.h"
+
+// Incremental peak detection and concentration. Points are fed one at a time
+// while the sweep runs; the tracker keeps the running maximum and its
+// neighbours (for a parabolic sub-step peak position) and the first and last
+// few points (for a linear baseline), so the result is ready the moment the
+// sweep ends without a second pass over the samples.
+
+// Points averaged at each end of the sweep for the baseline, at most.
+const uint8_t PEAK_EDGE_MAX_POINTS = 8;
+
+// Calibration line: current (µA) = slope * concentration + intercept. The
+// defaults match Web/server.py, which applies it to the raw peak current;
+// with baselineCorrected it is applied to the height above the baseline.
+struct PeakCalibration {
+    float slope;
+    float intercept;
+    bool baselineCorrected;
+};
+
+const PeakCalibration PEAK_CALIBRATION_DEFAULT = {0.03f, 1.0f, false};
+
+struct PeakTracker {
+    uint16_t count;
+    uint8_t edgeLen;
+    uint8_t flags;
+    // Running maximum and its neighbours.
+    uint16_t peakIndex;
+    int16_t peakV, leftV, rightV;
+    float peak, left, right;
+    bool rightPending;
+    int16_t prevV;
+    float prev;
+    // Baseline: sums over the first edgeLen points, ring of the last ones.
+    float headV, headI;
+    int16_t tailV[PEAK_EDGE_MAX_POINTS];
+    float tailI[PEAK_EDGE_MAX_POINTS];
+};
+
+// Starts a sweep of (about) expectedPoints points.
+void peakTrackerBegin(PeakTracker& tracker, uint16_t expectedPoints);
+
+// Adds the next point: potential (mV) and net current (µA).
+void peakTrackerAdd(PeakTracker& tracker, int16_t voltage, float currentUa);
+
+// Raises quality flags the tracker cannot see itself (PEAK_FLAG_SATURATED,
+// PEAK_FLAG_TIMING).
+inline void peakTrackerFlag(PeakTracker& tracker, uint8_t flags) {
+    tracker.flags |= flags;
+}
+
+// Computes the summary of the points added so far.
+void peakTrackerFinish(const PeakTracker& tracker, const PeakCalibration& calibration,
+                       PeakSummary& summary);
+
+// Runs the tracker over a recorded sweep.
+void analyzeSweep(const SweepBuffer& sweep, const PeakCalibration& calibration,
+                  PeakSummary& summary);
+
+// Concentration for a current (µA): 0 below 10, capped at 10000.
+float peakToConcentration(float currentUa, const PeakCalibration& calibration);
+
+#endif // PEAK_ANALYSIS_H
@@ -1,327 +1,1115 @@
 #include "pstat.h"
-#include <Wire.h>
-#include <SPIFFS.h>
 #include <math.h>
-#include "LMP91000.h"
+#include <stdlib.h>
+#include <string.h>
+#include "../hal/hal.h"
+#include "../hal/lmp91000_tables.h"
+#include "sweep_plan.h"
+#include "trace_log.h"
+#include "../util/metrics.h"
+#include "../util/spsc_queue.h"
 
 //────────────────────────────────────────────────────────────
 // Static Variables and Constants (Private to this module)
 //────────────────────────────────────────────────────────────
 static bool debugLevel = false; // Default debug off
 
-static const uint16_t opVolt = 3300;       // Operating voltage (mV)
 static const uint8_t adcBits = 12;         // ADC resolution (bits)
-static const uint16_t dacResolution = 255; // 8-bit DAC: 2^8 - 1
+static const uint16_t adcMaxCode = (1 << adcBits) - 1;
 
-// Pin definitions (adjust as needed)
-static const uint8_t dacPin   = 25;    // DAC output pin for Vref
-static const uint8_t MENB     = 5;     // Enable pin for LMP91000
-static const uint8_t LMP_ADC  = 35;    // ADC pin for reading LMP91000 Vout
-static const int LEDPIN       = 26;    // LED pin (for data-point signaling)
+// Note: Do not redefine TIA_BIAS, NUM_TIA_BIAS, and TIA_GAIN here,
+// since they are defined in lmp91000_tables.h
 
-// Calibration coefficients (hard-coded defaults)
-static float a_coeff = -146.63;
-static float b_coeff = 7.64;
+// One LMP91000 front end: its settings, and while a sweep runs, the buffer
+// it records into (owned by the caller) and its on-line analysis.
+struct Channel {
+    uint8_t gain = 7;
+    uint8_t bias = 0;              // bias setting index
+    float aCoeff = -146.63f;       // calibration coefficients (hard-coded defaults)
+    float bCoeff = 7.64f;
+    SweepBuffer* buffer = NULL;
+    PeakTracker peakTracker;
+    int64_t lastPointUs = 0;
+    DspScale scale;                // fixed-point code -> pA for this sweep
+    DspChain dsp;
+    uint16_t filteredCount = 0;    // DSP outputs stored so far
+    uint8_t underRanged = 0;       // consecutive points that could range up
+    uint8_t rangeGain = 0;         // gain to remember for this sweep window
+    bool rangedDown = false;       // a rail forced a lower gain this sweep
+    uint16_t gainSwitches = 0;
+};
 
-// Note: Do not redefine TIA_BIAS, NUM_TIA_BIAS, and TIA_GAIN here,
-// since they are defined in LMP91000.h
+static Channel channels[HAL_MAX_CHANNELS];
+HAL_RETAINED static uint32_t sweepCount;   // continues across deep sleep
 
-// Storage for SWV data
-static const uint16_t arr_samples = 5000;
-static uint16_t arr_cur_index = 0;
-static int16_t volts[arr_samples] = {0};
-static float amps[arr_samples] = {0};
-static int32_t time_Voltammaogram[arr_samples] = {0};
-static int number_of_valid_points_in_volts_amps_array = 0;
+// Fine pass of an adaptive sweep; its samples are kept for the next one.
+static SweepBuffer fineBuffer = {};
 
-// Timing variable used in sampling
-static unsigned long lastTime = 0;
+// Channels of the running sweep, in sampling order. The first one feeds the
+// listeners and the debug trace.
+static uint8_t sweepChannels[HAL_MAX_CHANNELS];
+static uint8_t numSweepChannels = 0;
 
-// DAC output variable (in mV)
-static uint16_t dacVout = 1500;
+// Sample pacing: the HAL pacer ticks once per half-period, so samples land
+// on an absolute µs schedule independent of the work done between them.
+static const uint32_t minHalfPeriodUs = 200;   // bias update budget, plus the ADC window
+static int64_t sweepStartUs = 0;
+static uint32_t missedTicks = 0;               // half-periods overrun by the loop
+static uint32_t requestedHalfPeriodUs = 0;
+static int64_t lastTickUs = 0;
+static uint32_t maxJitterUs = 0;               // worst |actual - requested| half-period this sweep
+static bool ledState = false;
+
+// Noise reduction of every sweep; the baseline stage waits for the merged
+// result during an adaptive sweep.
+static DspConfig dspConfig = DSP_CONFIG_OFF;
+static bool deferBaseline = false;
+
+// Automatic gain ranging. The gain each channel needed is remembered per
+// sweep window and becomes the starting gain of the next sweep over it.
+static AutoRangeConfig autoRange = AUTO_RANGE_OFF;
+static const uint8_t rangeUpPoints = 3;   // under-ranged points in a row before ranging up
+static uint8_t settleTicks = 0;           // half-periods to wait after a gain change
+
+// The remembered gains survive deep sleep, so duty-cycled sweeps start at
+// the right gain too.
+struct RangeMemo {
+    uint8_t channel;
+    int16_t startV;
+    int16_t endV;
+    uint8_t gain;
+};
+static const uint8_t maxRangeMemos = 8;
+HAL_RETAINED static RangeMemo rangeMemos[maxRangeMemos];
+HAL_RETAINED static uint8_t numRangeMemos;
+HAL_RETAINED static uint8_t nextRangeMemo;   // slot replaced when the table is full
 
-// Number of ADC readings to average
-static int num_adc_readings_to_average = 1;
+// Concentration calibration, shared by all channels.
+static PeakCalibration peakCalibration = PEAK_CALIBRATION_DEFAULT;
 
-// Global bias setting index.
-static uint8_t bias_setting = 0;
+// The calibration, DSP and auto-range settings are persisted in the config
+// store and loaded by pstatInit(), before any other task reads them.
+static const char* peakCalibrationKey = "peakcal";
+static const char* adcCalibrationKey = "adccal";
+static const char* dspConfigKey = "dsp";
+static const char* autoRangeKey = "range";
 
-// Global LMP gain (default 7)
-static uint8_t LMPgainGLOBAL = 7;
+// Calibration, DSP and auto-range updates come from another task (the HTTP
+// server). They are queued to the sweeping task, which takes them over before
+// its next sweep, so the sweep code reads the settings as they are; from
+// there they are queued on to pstatSaveSettings(). The updating task keeps
+// the latest update for the getters.
+struct SettingsUpdate {
+    bool hasCalibration;
+    bool hasDsp;
+    bool hasRange;
+    uint8_t adcChannels;           // channels whose entry in adc is set
+    PeakCalibration calibration;
+    DspConfig dsp;
+    AutoRangeConfig range;
+    AdcCalibration adc[HAL_MAX_CHANNELS];
+};
+static SpscQueue<SettingsUpdate, 8> settingsToApply;   // updater -> sweeping task
+static SpscQueue<SettingsUpdate, 8> settingsToSave;    // sweeping task -> saver
+static SettingsUpdate requested = {};                  // updater only
+
+// When the first ADC sample since boot was taken (halTimeUs()), 0 before.
+static int64_t firstSampleUs = 0;
+
+// Registered sweep observers.
+static const uint8_t maxListeners = 4;
+static const VoltammogramListener* listeners[maxListeners] = {NULL};
+static uint8_t numListeners = 0;
+static uint8_t numPointListeners = 0;   // listeners with an onPoint callback
+
+// DAC output variable (in mV)
+static uint16_t dacVout = 1500;
+
+// Number of ADC readings to average per half-period (see halAdcBegin()).
+static int num_adc_readings_to_average = 32;
 
-// Create a global LMP91000 instance.
-static LMP91000 pStat;
 
 //────────────────────────────────────────────────────────────
 // Internal Helper Functions (Private, Static)
 //────────────────────────────────────────────────────────────
 
-static void pulseLED_on_off(int pin, int on_duration_ms) {
-    digitalWrite(pin, HIGH);
-    delay(on_duration_ms);
-    digitalWrite(pin, LOW);
+static bool autoRangeValid(const AutoRangeConfig& config) {
+    return config.minGain >= 1 && config.maxGain <= 7 && config.minGain <= config.maxGain &&
+           config.headroomCodes < adcMaxCode / 4 && config.minSpanCodes > 0;
 }
 
-static inline uint16_t convertDACVoutToDACVal(uint16_t dacVout) {
-    return dacVout * ((float)dacResolution / opVolt);
+static bool peakCalibrationValid(const PeakCalibration& calibration) {
+    return isfinite(calibration.slope) && calibration.slope != 0.0f &&
+           isfinite(calibration.intercept);
 }
 
-static inline float analog_read_avg(int num_points, int pin_num) {
-    float sum = 0;
-    for (int i = 0; i < num_points; i++) {
-        sum += analogRead(pin_num);
-    }
-    return sum / num_points;
+static bool adcCalibrationValid(const AdcCalibration& calibration) {
+    return isfinite(calibration.aCoeff) && isfinite(calibration.bCoeff) &&
+           calibration.bCoeff != 0.0f;
 }
 
-static void setLMPBias(int16_t voltage) {
-    if (voltage < 0)
-        pStat.setNegBias();
-    else if (voltage > 0)
-        pStat.setPosBias();
+static void loadSettings() {
+    PeakCalibration calibration;
+    if (halConfigLoad(peakCalibrationKey, &calibration, sizeof(calibration)) &&
+        peakCalibrationValid(calibration))
+        peakCalibration = calibration;
+    DspConfig dsp;
+    if (halConfigLoad(dspConfigKey, &dsp, sizeof(dsp)) && dspConfigValidate(dsp) == NULL)
+        dspConfig = dsp;
+    AutoRangeConfig range;
+    if (halConfigLoad(autoRangeKey, &range, sizeof(range)) && autoRangeValid(range))
+        autoRange = range;
+    AdcCalibration adc[HAL_MAX_CHANNELS];
+    if (halConfigLoad(adcCalibrationKey, adc, sizeof(adc))) {
+        for (uint8_t ch = 0; ch < HAL_MAX_CHANNELS; ch++) {
+            if (!adcCalibrationValid(adc[ch]))
+                continue;
+            channels[ch].aCoeff = adc[ch].aCoeff;
+            channels[ch].bCoeff = adc[ch].bCoeff;
+        }
+    }
 }
 
-static void setOutputsToZero() {
-    dacWrite(dacPin, 0);
-    pStat.setBias(0);
+// Later updates replace earlier ones.
+static void mergeUpdate(SettingsUpdate& into, const SettingsUpdate& update) {
+    if (update.hasCalibration) {
+        into.hasCalibration = true;
+        into.calibration = update.calibration;
+    }
+    if (update.hasDsp) {
+        into.hasDsp = true;
+        into.dsp = update.dsp;
+    }
+    if (update.hasRange) {
+        into.hasRange = true;
+        into.range = update.range;
+    }
+    for (uint8_t ch = 0; ch < HAL_MAX_CHANNELS; ch++) {
+        if (update.adcChannels & (1u << ch))
+            into.adc[ch] = update.adc[ch];
+    }
+    into.adcChannels |= update.adcChannels;
 }
 
-static inline void reset_Voltammogram_arrays() {
-    for (uint16_t i = 0; i < arr_samples; i++) {
-        volts[i] = 0;
-        amps[i] = 0;
-        time_Voltammaogram[i] = 0;
+static bool queueUpdate(const SettingsUpdate& update) {
+    if (!settingsToApply.push(update)) {
+        if (debugLevel) {
+            halLogf("Settings update dropped: too many pending before the next sweep.");
+        }
+        return false;
     }
+    mergeUpdate(requested, update);
+    return true;
+}
+
+static void startSampleTimer(uint32_t halfPeriodUs) {
+    missedTicks = 0;
+    maxJitterUs = 0;
+    requestedHalfPeriodUs = halfPeriodUs;
+    sweepStartUs = halTimeUs();
+    lastTickUs = sweepStartUs;
+    halPacerStart(halfPeriodUs);
 }
 
-static inline void saveVoltammogram(float voltage, float current) {
-    volts[arr_cur_index] = (int16_t)voltage;
-    amps[arr_cur_index] = current;
-    time_Voltammaogram[arr_cur_index] = millis();
-    arr_cur_index++;
-    number_of_valid_points_in_volts_amps_array++;
+// Blocks until the current half-period ends, and records how far the
+// half-period actually observed by the loop was from the requested one.
+static inline void waitForSampleTick() {
+    uint32_t start = metricsStart();
+    uint32_t ticks = halPacerWait();
+    metricsEnd(PHASE_TICK_WAIT, start);
+    if (ticks > 1)
+        missedTicks += ticks - 1;
+
+    int64_t now = halTimeUs();
+    int32_t deviation = (int32_t)(now - lastTickUs) - (int32_t)requestedHalfPeriodUs;
+    lastTickUs = now;
+    metricsHalfPeriodJitter(deviation);
+    uint32_t magnitude = deviation < 0 ? -deviation : deviation;
+    if (magnitude > maxJitterUs)
+        maxJitterUs = magnitude;
 }
 
-static void setVoltage(int16_t voltage) {
-    const uint16_t minDACVoltage = 1520;
-    dacVout = minDACVoltage;
-    bias_setting = 0;
+// Toggles the LED once per sample so it mirrors the excitation without blocking.
+static inline void signalDataPoint() {
+    ledState = !ledState;
+    halLedWrite(ledState);
+}
 
-    int16_t setV = dacVout * TIA_BIAS[bias_setting];
-    voltage = abs(voltage);
+// Zeroes the reference and the bias of one channel.
+static void setOutputsToZero(uint8_t channel) {
+    halDacWrite(0);
+    halSelectChannel(channel);
+    halLmpSetBias(0, 0);
+}
 
-    if (voltage < 15) {
-        if (voltage > 7.5)
-            voltage = 15;
-        else {
-            bias_setting = 0;
-            setV = 0;
-            dacVout = 1500;
+//────────────────────────────────────────────────────────────
+// Auto-ranging (Internal)
+//────────────────────────────────────────────────────────────
+
+static RangeMemo* findRangeMemo(uint8_t channel, int16_t startV, int16_t endV) {
+    for (uint8_t i = 0; i < numRangeMemos; i++) {
+        RangeMemo& memo = rangeMemos[i];
+        if (memo.channel == channel && memo.startV == startV && memo.endV == endV)
+            return &memo;
+    }
+    return NULL;
+}
+
+static void rememberRange(uint8_t channel, int16_t startV, int16_t endV, uint8_t gain) {
+    RangeMemo* memo = findRangeMemo(channel, startV, endV);
+    if (memo == NULL) {
+        if (numRangeMemos < maxRangeMemos) {
+            memo = &rangeMemos[numRangeMemos++];
+        } else {
+            memo = &rangeMemos[nextRangeMemo];
+            nextRangeMemo = (nextRangeMemo + 1) % maxRangeMemos;
         }
+        memo->channel = channel;
+        memo->startV = startV;
+        memo->endV = endV;
     }
+    memo->gain = gain;
+}
 
-    if (voltage >= 15) {
-        const float v_tolerance = 0.008;
-        while (setV > voltage * (1 + v_tolerance) || setV < voltage * (1 - v_tolerance)) {
-            if (bias_setting == 0)
-                bias_setting = 1;
-            dacVout = voltage / TIA_BIAS[bias_setting];
-            if (dacVout > opVolt) {
-                bias_setting++;
-                dacVout = 1500;
-                if (bias_setting > NUM_TIA_BIAS)
-                    bias_setting = 0;
-            }
-            setV = dacVout * TIA_BIAS[bias_setting];
+// Starting gain of a channel for a sweep window.
+static uint8_t startingGain(uint8_t channel, int16_t startV, int16_t endV, uint8_t gain) {
+    const RangeMemo* memo = findRangeMemo(channel, startV, endV);
+    if (memo != NULL)
+        gain = memo->gain;
+    if (gain < autoRange.minGain)
+        return autoRange.minGain;
+    return gain > autoRange.maxGain ? autoRange.maxGain : gain;
+}
+
+static inline bool nearRail(uint16_t code) {
+    return code <= autoRange.headroomCodes || code >= adcMaxCode - autoRange.headroomCodes;
+}
+
+// ADC code of zero cell current at a reference output (see currentToAdc()).
+static inline float zeroCurrentCode(const Channel& ch, uint16_t dacMv) {
+    return ch.aCoeff + ch.bCoeff * dacMv * (255.0f / 3300.0f);
+}
+
+// True if a code is under-ranged: close to the zero-current code, and still
+// clear of the rails by twice the headroom once scaled by `ratio`.
+static inline bool underRanged(float zero, uint16_t code, float ratio) {
+    float deflection = code - zero;
+    if (fabsf(deflection) >= autoRange.minSpanCodes)
+        return false;
+    float scaled = zero + deflection * ratio;
+    return scaled > 2.0f * autoRange.headroomCodes && scaled < adcMaxCode - 2.0f * autoRange.headroomCodes;
+}
+
+// Changes a channel's TIA gain mid-sweep. The gain to remember is the
+// lowest one a rail forced, or without one the highest one reached.
+static void switchGain(Channel& ch, uint8_t channel, uint8_t gain) {
+    if (gain < ch.gain) {
+        ch.rangeGain = (!ch.rangedDown || gain < ch.rangeGain) ? gain : ch.rangeGain;
+        ch.rangedDown = true;
+    } else if (!ch.rangedDown && gain > ch.rangeGain) {
+        ch.rangeGain = gain;
+    }
+    ch.gainSwitches++;
+    ch.gain = gain;
+    ch.underRanged = 0;
+    halSelectChannel(channel);
+    halLmpSetGain(gain);
+    dspScaleBegin(ch.scale, gain, ch.bCoeff);
+    metricsCount(COUNTER_GAIN_SWITCHES, 1);
+}
+
+// Ranges down every channel with a code near an ADC rail. Returns true if
+// any channel changed; the point is then sampled again.
+static bool rangeDown(const uint16_t* adcForward, const uint16_t* adcReverse) {
+    bool switched = false;
+    for (uint8_t k = 0; k < numSweepChannels; k++) {
+        Channel& ch = channels[sweepChannels[k]];
+        if ((nearRail(adcForward[k]) || nearRail(adcReverse[k])) && ch.gain > autoRange.minGain) {
+            switchGain(ch, sweepChannels[k], ch.gain - 1);
+            switched = true;
         }
     }
+    return switched;
+}
 
-    pStat.setBias(bias_setting);
-    dacWrite(dacPin, convertDACVoutToDACVal(dacVout));
+// Ranges a channel up after rangeUpPoints under-ranged points in a row.
+// Returns true if it changed.
+static bool rangeUp(Channel& ch, uint8_t channel, const PulseSetting& forward, uint16_t adcForward,
+                    const PulseSetting& reverse, uint16_t adcReverse) {
+    if (ch.gain == 0 || ch.gain >= autoRange.maxGain)
+        return false;
+    float ratio = (float)(TIA_GAIN[ch.gain] / TIA_GAIN[ch.gain - 1]);
+    if (!underRanged(zeroCurrentCode(ch, forward.dacVout), adcForward, ratio) ||
+        !underRanged(zeroCurrentCode(ch, reverse.dacVout), adcReverse, ratio)) {
+        ch.underRanged = 0;
+        return false;
+    }
+    if (++ch.underRanged < rangeUpPoints)
+        return false;
+    switchGain(ch, channel, ch.gain + 1);
+    return true;
+}
+
+// Holds the bias while the TIA settles after a gain change.
+static void settleGain() {
+    for (uint8_t i = 0; i < settleTicks; i++)
+        waitForSampleTick();
+}
+
+// Stores the next DSP output of a channel and feeds it to the analysis.
+static inline void addFiltered(Channel& ch, int32_t currentPa) {
+    SweepBuffer& buf = *ch.buffer;
+    if (ch.filteredCount >= buf.numPoints)
+        return;
+    buf.filteredPa[ch.filteredCount] = currentPa;
+    peakTrackerAdd(ch.peakTracker, sweepPointV(buf, ch.filteredCount), currentPa * 1e-6f);
+    ch.filteredCount++;
 }
 
-static float biasAndSample(int16_t voltage, uint32_t rate) {
-    setLMPBias(voltage);
-    setVoltage(voltage);
+// Stores one point of a channel. `now` is when its reverse sample was read.
+static inline void saveVoltammogram(Channel& ch, bool notify, int64_t now, uint16_t step,
+                                    const PulseSetting& forward, uint16_t adcForward,
+                                    const PulseSetting& reverse, uint16_t adcReverse) {
+    SweepBuffer& buf = *ch.buffer;
+    uint16_t index = buf.numPoints;
+    if (index >= buf.capacity)
+        return;
+
+    int32_t jitter = (int32_t)(now - ch.lastPointUs) - 2 * (int32_t)buf.halfPeriodUs;
+    if (jitter > INT16_MAX)
+        jitter = INT16_MAX;
+    else if (jitter < INT16_MIN)
+        jitter = INT16_MIN;
+    if (index == 0)
+        buf.firstPointUs = (int32_t)(now - sweepStartUs);
+    ch.lastPointUs = now;
 
-    if (rate > 10)
-        pulseLED_on_off(LEDPIN, 10);
-    else
-        pulseLED_on_off(LEDPIN, 1);
+    SweepSample& sample = buf.samples[index];
+    sample.step = step;
+    sample.adcForward = adcForward;
+    sample.adcReverse = adcReverse;
+    sample.jitterUs = (int16_t)jitter;
+    sample.gain = ch.gain;
+    buf.numPoints++;
+
+    // The analysis and listeners get converted values; storage keeps the raw
+    // codes. The conversion is fixed point; with the DSP chain on, the
+    // analysis sees its (delayed) output instead.
+    int32_t currentPa = dspNetCurrentPa(ch.scale, adcForward, forward.dacVout, adcReverse, reverse.dacVout);
+    float current = currentPa * 1e-6f;
+    int16_t voltage = sweepPointV(buf, index);
+    if (adcForward == 0 || adcForward >= adcMaxCode || adcReverse == 0 || adcReverse >= adcMaxCode)
+        peakTrackerFlag(ch.peakTracker, PEAK_FLAG_SATURATED);
+    if (buf.filteredPa != NULL) {
+        int32_t filtered;
+        if (dspPush(ch.dsp, currentPa, filtered))
+            addFiltered(ch, filtered);
+    } else {
+        peakTrackerAdd(ch.peakTracker, voltage, current);
+    }
+
+    if (notify && numPointListeners > 0) {
+        int32_t timeUs = (int32_t)(now - sweepStartUs);
+        for (uint8_t i = 0; i < numListeners; i++) {
+            if (listeners[i]->onPoint)
+                listeners[i]->onPoint(index, voltage, current, timeUs);
+        }
+    }
+}
 
-    while (millis() - lastTime < rate) { }
+// Sizes the sample array of a buffer to hold numPoints, and its DSP output
+// array (same capacity) if `filtered`, releasing it otherwise.
+static bool reserveSweepBuffer(SweepBuffer& buf, uint16_t numPoints, bool filtered) {
+    // Explicit point times only belong to a merged sweep (see mergeFinePass()).
+    free(buf.pointUs);
+    buf.pointUs = NULL;
+    if (!filtered && buf.filteredPa != NULL) {
+        free(buf.filteredPa);
+        buf.filteredPa = NULL;
+    }
+    if (buf.samples == NULL || buf.capacity < numPoints) {
+        SweepSample* samples = (SweepSample*)realloc(buf.samples, numPoints * sizeof(SweepSample));
+        if (samples == NULL)
+            return false;
+        buf.samples = samples;
+        if (buf.filteredPa != NULL) {
+            int32_t* values = (int32_t*)realloc(buf.filteredPa, numPoints * sizeof(int32_t));
+            if (values == NULL)
+                return false;
+            buf.filteredPa = values;
+        }
+        buf.capacity = numPoints;
+    }
+    if (filtered && buf.filteredPa == NULL) {
+        buf.filteredPa = (int32_t*)malloc(buf.capacity * sizeof(int32_t));
+        if (buf.filteredPa == NULL)
+            return false;
+    }
+    return true;
+}
 
-    int adc_bits = analog_read_avg(num_adc_readings_to_average, LMP_ADC);
+// Applies the bias for the next half-period on every channel of the sweep
+// and samples them all at its end. The reference DAC is shared, so the
+// channels step through the plan in lockstep: at each tick they are read one
+// after another, each while the rest are still settled in the half-period,
+// and each one's samples stay exactly one half-period apart. The bias change
+// follows the previous samples immediately; the samples are taken on the
+// pacer tick.
+static void biasAndSample(const PulseSetting& pulse, uint16_t* adcCodes, int64_t* readUs) {
+    uint32_t start = metricsStart();
+    dacVout = pulse.dacVout;
+    for (uint8_t k = 0; k < numSweepChannels; k++) {
+        Channel& ch = channels[sweepChannels[k]];
+        halSelectChannel(sweepChannels[k]);
+        ch.bias = pulse.biasIndex;
+        halLmpSetBias(ch.bias, pulse.sign);
+    }
+    metricsEnd(PHASE_LMP_BIAS, start);
 
-    float a = a_coeff;
-    float b = b_coeff;
-    float v1 = (3.3 / 255.0) * (1 / (2.0 * b)) * (float)adc_bits - (a / (2.0 * b)) * (3.3 / 255.0);
-    v1 = v1 * 1000;
-    float v2 = dacVout * 0.5;
+    start = metricsStart();
+    halDacWrite(pulse.dacCode);
+    metricsEnd(PHASE_DAC_WRITE, start);
+    signalDataPoint();
 
-    float current = 0;
-    // --- Modification here: always return microAmps ---
-    if (LMPgainGLOBAL == 0)
-        current = (((v1 - v2) / 1000) / 1e6) * pow(10, 6);  // now in μA instead of nA
-    else
-        current = (((v1 - v2) / 1000) / TIA_GAIN[LMPgainGLOBAL - 1]) * pow(10, 6);
+    waitForSampleTick();
 
+    for (uint8_t k = 0; k < numSweepChannels; k++) {
+        start = metricsStart();
+        halSelectChannel(sweepChannels[k]);
+        adcCodes[k] = halAdcRead();
+        readUs[k] = halTimeUs();
+        metricsEnd(PHASE_ADC_READ, start);
+    }
+    if (firstSampleUs == 0)
+        firstSampleUs = readUs[0];
+
+    // Debug output is only queued here; the trace task prints it.
     if (debugLevel) {
-        Serial.print(millis());
-        Serial.print("\tDesired V: ");
-        Serial.print(voltage);
-        Serial.print("\tSet V: ");
-        Serial.print(dacVout * TIA_BIAS[bias_setting]);
-        Serial.print("\tDAC: ");
-        Serial.print(dacVout);
-        Serial.print("\tADC: ");
-        Serial.print(adc_bits);
-        Serial.print("\tVout: ");
-        Serial.print(v1);
-        Serial.print("\tZero: ");
-        Serial.print(v2);
-        Serial.print("\tI: ");
-        Serial.println(current, 4);
-    }
-
-    lastTime = millis();
-    return current;
+        const Channel& ch = channels[sweepChannels[0]];
+        TraceRecord record;
+        record.timeUs = (uint32_t)readUs[0];
+        record.desiredMv = pulse.mV;
+        record.dacVout = dacVout;
+        record.adc = adcCodes[0];
+        record.type = TRACE_SAMPLE;
+        record.biasIndex = ch.bias;
+        record.currentUa = adcToCurrent(adcCodes[0], dacVout, ch.gain, ch.aCoeff, ch.bCoeff);
+        traceLogPush(record);
+    }
 }
 
 //────────────────────────────────────────────────────────────
-// SWV Functions (Internal: Static Forward and Backward)
+// SWV Functions (Internal)
 //────────────────────────────────────────────────────────────
 
-static void runSWVForward(int16_t startV, int16_t endV, int16_t pulseAmp, int16_t stepV, uint16_t delay_ms) {
-    float i_forward = 0;
-    float i_backward = 0;
-    for (int16_t j = startV; j <= endV; j += stepV) {
-        i_forward = biasAndSample(j + pulseAmp, delay_ms);
-        i_backward = biasAndSample(j - pulseAmp, delay_ms);
-        saveVoltammogram(j, i_forward - i_backward);
+// Walks a precomputed plan: forward pulse, reverse pulse, save both codes
+// of every channel. With auto-ranging, a point that hit an ADC rail is
+// sampled again (on every channel, as they run in lockstep) after its gain
+// has dropped and settled.
+static void runSWVPlan(const SweepPlan& plan) {
+    uint16_t adcForward[HAL_MAX_CHANNELS], adcReverse[HAL_MAX_CHANNELS];
+    int64_t forwardUs[HAL_MAX_CHANNELS], reverseUs[HAL_MAX_CHANNELS];
+    for (uint16_t i = 0; i < plan.numPoints;) {
+        const PulseSetting& forward = plan.pulses[2 * i];
+        const PulseSetting& reverse = plan.pulses[2 * i + 1];
+        biasAndSample(forward, adcForward, forwardUs);
+        biasAndSample(reverse, adcReverse, reverseUs);
+        if (autoRange.enabled && rangeDown(adcForward, adcReverse)) {
+            settleGain();
+            continue;
+        }
+        uint32_t start = metricsStart();
+        bool switched = false;
+        for (uint8_t k = 0; k < numSweepChannels; k++) {
+            Channel& ch = channels[sweepChannels[k]];
+            saveVoltammogram(ch, k == 0, reverseUs[k], i, forward, adcForward[k], reverse, adcReverse[k]);
+            if (autoRange.enabled)
+                switched |= rangeUp(ch, sweepChannels[k], forward, adcForward[k], reverse, adcReverse[k]);
+        }
+        metricsEnd(PHASE_POINT_SAVE, start);
+        if (switched)
+            settleGain();
+        i++;
         if (debugLevel) {
-            Serial.println("EOL");
+            TraceRecord record = {};
+            record.timeUs = (uint32_t)halTimeUs();
+            record.type = TRACE_POINT_END;
+            traceLogPush(record);
         }
     }
 }
 
-static void runSWVBackward(int16_t startV, int16_t endV, int16_t pulseAmp, int16_t stepV, uint16_t delay_ms) {
-    float i_forward = 0;
-    float i_backward = 0;
-    for (int16_t j = startV; j >= endV; j -= stepV) {
-        i_forward = biasAndSample(j + pulseAmp, delay_ms);
-        i_backward = biasAndSample(j - pulseAmp, delay_ms);
-        saveVoltammogram(j, i_forward - i_backward);
+// Configures one channel's LMP91000 for a sweep at its gain.
+static void initChannel(uint8_t channel) {
+    halSelectChannel(channel);
+    halLmpInit(channels[channel].gain);
+    halLmpSetBias(0, 0);
+    channels[channel].bias = 0;
+}
+
+// One sweep over the channels in channelMask, each recording into
+// out[channel].
+static bool runSweep(SweepBuffer* const out[], uint8_t channelMask, int16_t startV, int16_t endV,
+                     int16_t pulseAmp, int16_t stepV, double freq, bool setToZero) {
+    uint32_t sweepStart = metricsStart();
+    if (freq <= 0) {
         if (debugLevel) {
-            Serial.println("EOL");
+            halLogf("runSWV: frequency must be positive.");
         }
+        return false;
+    }
+
+    numSweepChannels = 0;
+    for (uint8_t c = 0; c < HAL_MAX_CHANNELS; c++) {
+        if (channelMask & (1u << c)) {
+            if (c >= halChannelCount() || out[c] == NULL) {
+                if (debugLevel) {
+                    halLogf("runSWV: channel %u is not available.", c);
+                }
+                return false;
+            }
+            sweepChannels[numSweepChannels++] = c;
+        }
+    }
+    if (numSweepChannels == 0)
+        return false;
+    // The passes of an adaptive sweep keep the settings it started with.
+    if (!deferBaseline)
+        pstatApplySettings();
+
+    SweepPlan plan;
+    if (!buildSweepPlan(plan, startV, endV, pulseAmp, stepV, SWEEP_MAX_POINTS)) {
+        if (debugLevel) {
+            halLogf("runSWV: sweep plan rejected (step must be non-zero, at most %u points).",
+                    SWEEP_MAX_POINTS);
+        }
+        return false;
+    }
+    for (uint8_t k = 0; k < numSweepChannels; k++) {
+        if (!reserveSweepBuffer(*out[sweepChannels[k]], plan.numPoints, dspConfigActive(dspConfig))) {
+            freeSweepPlan(plan);
+            if (debugLevel) {
+                halLogf("runSWV: not enough memory for the sweep samples.");
+            }
+            return false;
+        }
+    }
+
+    halDacWrite(0);
+    for (uint8_t k = 0; k < numSweepChannels; k++) {
+        Channel& ch = channels[sweepChannels[k]];
+        if (autoRange.enabled)
+            ch.gain = startingGain(sweepChannels[k], startV, endV, ch.gain);
+        ch.rangeGain = ch.gain;
+        ch.rangedDown = false;
+        ch.gainSwitches = 0;
+        ch.underRanged = 0;
+        initChannel(sweepChannels[k]);
+    }
+
+    // Capture ADC bursts for the duration of the sweep.
+    if (!halAdcBegin(num_adc_readings_to_average, channelMask) && debugLevel) {
+        halLogf("runSWV: ADC burst capture unavailable, using one-shot reads.");
+    }
+
+    // Convert frequency (Hz) to the half-period in µs. Every channel's bias
+    // update and ADC window have to fit in each half-period.
+    uint32_t halfPeriodUs = (uint32_t)(1000000.0 / (2 * freq));
+    uint32_t minPeriodUs = numSweepChannels * (minHalfPeriodUs + halAdcWindowUs());
+    if (halfPeriodUs < minPeriodUs)
+        halfPeriodUs = minPeriodUs;
+    settleTicks = (autoRange.settleUs + halfPeriodUs - 1) / halfPeriodUs;
+
+    for (uint8_t k = 0; k < numSweepChannels; k++) {
+        Channel& ch = channels[sweepChannels[k]];
+        SweepBuffer& buf = *out[sweepChannels[k]];
+        buf.sweepId = ++sweepCount;
+        buf.channel = sweepChannels[k];
+        buf.numPoints = 0;
+        buf.gain = ch.gain;
+        buf.startV = plan.startV;
+        buf.stepV = plan.stepV;
+        buf.pulseAmp = abs(pulseAmp);
+        buf.halfPeriodUs = halfPeriodUs;
+        buf.firstPointUs = 0;
+        buf.aCoeff = ch.aCoeff;
+        buf.bCoeff = ch.bCoeff;
+        ch.buffer = &buf;
+        peakTrackerBegin(ch.peakTracker, plan.numPoints);
+        dspScaleBegin(ch.scale, ch.gain, ch.bCoeff);
+        dspBegin(ch.dsp, dspConfig);
+        ch.filteredCount = 0;
+    }
+
+    const SweepBuffer& first = *channels[sweepChannels[0]].buffer;
+    for (uint8_t i = 0; i < numListeners; i++) {
+        if (listeners[i]->onSweepStart)
+            listeners[i]->onSweepStart(first.sweepId, first.channel, plan.numPoints);
+    }
+
+    metricsEnd(PHASE_SWEEP_SETUP, sweepStart);
+    startSampleTimer(halfPeriodUs);
+    for (uint8_t k = 0; k < numSweepChannels; k++)
+        channels[sweepChannels[k]].lastPointUs = sweepStartUs;
+    runSWVPlan(plan);
+    halPacerStop();
+    halAdcEnd();
+    freeSweepPlan(plan);
+
+    uint32_t points = 0;
+    for (uint8_t k = 0; k < numSweepChannels; k++) {
+        Channel& ch = channels[sweepChannels[k]];
+        SweepBuffer& buf = *ch.buffer;
+        if (buf.filteredPa != NULL) {
+            int32_t held[DSP_MAX_WINDOW];
+            uint8_t n = dspFlush(ch.dsp, held);
+            for (uint8_t i = 0; i < n; i++)
+                addFiltered(ch, held[i]);
+        }
+        if (missedTicks > 0)
+            peakTrackerFlag(ch.peakTracker, PEAK_FLAG_TIMING);
+        peakTrackerFinish(ch.peakTracker, peakCalibration, buf.summary);
+        if (autoRange.enabled) {
+            rememberRange(sweepChannels[k], startV, endV, ch.rangeGain);
+            if (debugLevel && ch.gainSwitches > 0) {
+                halLogf("runSWV: channel %u changed gain %u times (from %u to %u); next sweep starts at %u.",
+                        sweepChannels[k], ch.gainSwitches, buf.gain, ch.gain, ch.rangeGain);
+            }
+        }
+
+        // The baseline fit needs the whole sweep; the analysis is redone on
+        // the corrected values.
+        if (buf.filteredPa != NULL && dspConfig.baseline != DSP_BASELINE_NONE && !deferBaseline) {
+            dspRemoveBaseline(dspConfig, buf, buf.filteredPa, buf.numPoints);
+            analyzeSweep(buf, peakCalibration, buf.summary);
+            if (missedTicks > 0)
+                buf.summary.flags |= PEAK_FLAG_TIMING;
+        }
+        points += buf.numPoints;
+    }
+
+    for (uint8_t i = 0; i < numListeners; i++) {
+        if (listeners[i]->onSweepEnd)
+            listeners[i]->onSweepEnd(first.sweepId, first.channel, first.numPoints);
+    }
+    for (uint8_t k = 0; k < numSweepChannels; k++)
+        channels[sweepChannels[k]].buffer = NULL;
+
+    ledState = false;
+    halLedWrite(false);
+
+    if (setToZero) {
+        for (uint8_t k = 0; k < numSweepChannels; k++)
+            setOutputsToZero(sweepChannels[k]);
     }
+    halSelectChannel(0);
+
+    metricsEnd(PHASE_SWEEP, sweepStart);
+    metricsCount(COUNTER_SWEEPS, numSweepChannels);
+    metricsCount(COUNTER_POINTS, points);
+    metricsCount(COUNTER_MISSED_TICKS, missedTicks);
+    metricsSetGauge(GAUGE_LAST_SWEEP_MAX_JITTER_US, maxJitterUs);
+
+    if (debugLevel) {
+        halLogf("runSWV complete. Channels: %u, half-period (us): %lu, missed ticks: %lu, max jitter (us): %lu",
+                numSweepChannels, (unsigned long)halfPeriodUs, (unsigned long)missedTicks,
+                (unsigned long)maxJitterUs);
+    }
+    return true;
 }
 
 //────────────────────────────────────────────────────────────
-// Public SWV Function
+// Public SWV Functions
 //────────────────────────────────────────────────────────────
 
-void runSWV(uint8_t newGain, int16_t startV, int16_t endV,
+bool runSWV(SweepBuffer& out, uint8_t newGain, int16_t startV, int16_t endV,
             int16_t pulseAmp, int16_t stepV, double freq, bool setToZero) {
-    LMPgainGLOBAL = newGain;
-    stepV = abs(stepV);
-    pulseAmp = abs(pulseAmp);
+    channels[0].gain = newGain;
+    SweepBuffer* buffers[HAL_MAX_CHANNELS] = {&out};
+    return runSweep(buffers, 0x01, startV, endV, pulseAmp, stepV, freq, setToZero);
+}
+
+bool runSWVChannels(SweepBuffer* const out[], uint8_t channelMask, int16_t startV, int16_t endV,
+                    int16_t pulseAmp, int16_t stepV, double freq, bool setToZero) {
+    return runSweep(out, channelMask, startV, endV, pulseAmp, stepV, freq, setToZero);
+}
 
-    // Convert frequency (Hz) to delay (ms) for half period.
-    uint16_t delay_ms = (uint16_t)(1000.0 / (2 * freq));
-    if (delay_ms > 1)
-        delay_ms -= 1;
+//────────────────────────────────────────────────────────────
+// Adaptive SWV
+//────────────────────────────────────────────────────────────
 
-    reset_Voltammogram_arrays();
-    arr_cur_index = 0;
-    number_of_valid_points_in_volts_amps_array = 0;
+// Merges the fine pass into the coarse sweep `out`, in sweep order: coarse
+// points before the fine window, the fine points, coarse points after it.
+// `out` is re-expressed on the fine step grid (the coarse step is `ratio`
+// fine steps), so every point keeps its potential. f0 is the fine-grid step
+// of the first fine point. Point times are kept explicitly, since in sweep
+// order they jump at the window edges; fineStartUs is when the fine pass
+// started, relative to the coarse one.
+static bool mergeFinePass(SweepBuffer& out, const SweepBuffer& fine, uint16_t ratio, uint16_t f0,
+                          int32_t fineStartUs) {
+    uint16_t numCoarse = out.numPoints;
+    uint16_t numFine = fine.numPoints;
+    bool filtered = out.filteredPa != NULL && fine.filteredPa != NULL;
+    if ((uint32_t)(numCoarse - 1) * ratio > UINT16_MAX ||
+        !reserveSweepBuffer(out, numCoarse + numFine, filtered))
+        return false;
+    int32_t* times = (int32_t*)malloc(out.capacity * sizeof(int32_t));
+    if (times == NULL)
+        return false;
+    int32_t period = 2 * (int32_t)out.halfPeriodUs;
+    for (uint16_t i = 0; i < numCoarse; i++)
+        times[i] = i == 0 ? out.firstPointUs : times[i - 1] + period + out.samples[i].jitterUs;
 
-    pstatInit(newGain);
+    uint16_t head = 0;   // coarse points before the window
+    while (head < numCoarse && (uint32_t)head * ratio < f0)
+        head++;
+    uint16_t tail = head;   // first coarse point after it
+    while (tail < numCoarse && (uint32_t)tail * ratio < (uint32_t)f0 + numFine)
+        tail++;
+    uint16_t numTail = numCoarse - tail;
 
-    if (startV < endV)
-        runSWVForward(startV, endV, pulseAmp, stepV, delay_ms);
-    else
-        runSWVBackward(startV, endV, pulseAmp, stepV, delay_ms);
+    memmove(&out.samples[head + numFine], &out.samples[tail], numTail * sizeof(SweepSample));
+    memcpy(&out.samples[head], fine.samples, numFine * sizeof(SweepSample));
+    if (filtered) {
+        memmove(&out.filteredPa[head + numFine], &out.filteredPa[tail], numTail * sizeof(int32_t));
+        memcpy(&out.filteredPa[head], fine.filteredPa, numFine * sizeof(int32_t));
+    }
+    memmove(&times[head + numFine], &times[tail], numTail * sizeof(int32_t));
+    int32_t finePeriod = 2 * (int32_t)fine.halfPeriodUs;
+    for (uint16_t j = 0; j < numFine; j++) {
+        times[head + j] = j == 0 ? fineStartUs + fine.firstPointUs
+                                 : times[head + j - 1] + finePeriod + fine.samples[j].jitterUs;
+    }
+    for (uint16_t i = 0; i < head; i++)
+        out.samples[i].step = i * ratio;
+    for (uint16_t j = 0; j < numFine; j++)
+        out.samples[head + j].step = f0 + j;
+    for (uint16_t i = 0; i < numTail; i++)
+        out.samples[head + numFine + i].step = (tail + i) * ratio;
+
+    out.numPoints = head + numFine + numTail;
+    out.stepV = fine.stepV;
+    out.pointUs = times;
+    out.firstPointUs = times[0];
+    return true;
+}
 
-    arr_cur_index = 0;
-    if (setToZero)
-        setOutputsToZero();
+// Coarse pass, then the fine pass merged into it. Returns false only if the
+// coarse pass failed; keeps the coarse sweep if the fine one does.
+static bool runAdaptivePasses(SweepBuffer& out, uint8_t newGain, int16_t startV, int16_t endV,
+                              int16_t pulseAmp, uint16_t fine, uint16_t coarse, int16_t windowMv,
+                              double freq, bool setToZero, uint8_t& timingFlags) {
+    // The coarse grid has to lie on the fine one.
+    uint16_t ratio = (coarse + fine - 1) / fine;
+    int16_t dir = endV < startV ? -1 : 1;
+    if (!runSWV(out, newGain, startV, endV, pulseAmp, dir * ratio * fine, freq, false))
+        return false;
+    timingFlags = out.summary.flags & PEAK_FLAG_TIMING;
+    int64_t coarseStartUs = sweepStartUs;
 
+    // Without a peak in the coarse pass there is nothing to refine.
+    if (out.summary.flags & (PEAK_FLAG_NO_PEAK | PEAK_FLAG_EDGE)) {
+        if (setToZero)
+            setOutputsToZero(0);
+        if (debugLevel) {
+            halLogf("runAdaptiveSWV: no peak in the coarse pass (flags 0x%02x); fine pass skipped.",
+                    out.summary.flags);
+        }
+        return true;
+    }
+
+    // Fine window around the coarse peak, in fine steps from startV along
+    // the sweep, inside the range the coarse pass covered.
+    int32_t lastStep = (int32_t)(out.numPoints - 1) * ratio;
+    float peakSteps = (out.summary.peakMv - startV) * dir / (float)fine;
+    int32_t f0 = (int32_t)floorf(peakSteps - (float)windowMv / fine);
+    int32_t f1 = (int32_t)ceilf(peakSteps + (float)windowMv / fine);
+    if (f0 < 0)
+        f0 = 0;
+    if (f1 > lastStep)
+        f1 = lastStep;
+    if (f1 <= f0) {
+        if (setToZero)
+            setOutputsToZero(0);
+        return true;
+    }
+
+    uint32_t coarseId = out.sweepId;
+    bool ok = runSWV(fineBuffer, newGain, startV + dir * f0 * fine, startV + dir * f1 * fine,
+                     pulseAmp, dir * fine, freq, setToZero);
+    sweepCount = coarseId;   // both passes are one measurement
+    if (!ok || !mergeFinePass(out, fineBuffer, ratio, (uint16_t)f0, (int32_t)(sweepStartUs - coarseStartUs))) {
+        if (setToZero)
+            setOutputsToZero(0);
+        if (debugLevel) {
+            halLogf("runAdaptiveSWV: fine pass failed; keeping the coarse sweep.");
+        }
+        return true;
+    }
+    timingFlags |= fineBuffer.summary.flags & PEAK_FLAG_TIMING;
     if (debugLevel) {
-        Serial.println("runSWV complete.");
+        halLogf("runAdaptiveSWV: %u points (%u fine from %d to %d mV)", out.numPoints,
+                fineBuffer.numPoints, startV + dir * (int)f0 * fine, startV + dir * (int)f1 * fine);
     }
+    return true;
+}
+
+bool runAdaptiveSWV(SweepBuffer& out, uint8_t newGain, int16_t startV, int16_t endV,
+                    int16_t pulseAmp, int16_t stepV, int16_t coarseStepV, int16_t windowMv,
+                    double freq, bool setToZero) {
+    uint16_t fine = abs(stepV);
+    uint16_t coarse = abs(coarseStepV);
+    if (fine == 0 || coarse <= fine || windowMv <= 0)
+        return runSWV(out, newGain, startV, endV, pulseAmp, stepV, freq, setToZero);
+
+    uint8_t timingFlags = 0;
+    pstatApplySettings();
+    deferBaseline = true;
+    bool ok = runAdaptivePasses(out, newGain, startV, endV, pulseAmp, fine, coarse, windowMv,
+                                freq, setToZero, timingFlags);
+    deferBaseline = false;
+    if (!ok)
+        return false;
+
+    if (out.filteredPa != NULL)
+        dspRemoveBaseline(dspConfig, out, out.filteredPa, out.numPoints);
+    analyzeSweep(out, peakCalibration, out.summary);
+    out.summary.flags |= timingFlags;
+    return true;
+}
+
+void setNextSweepId(uint32_t sweepId) {
+    sweepCount = sweepId > 0 ? sweepId - 1 : 0;
 }
 
 //────────────────────────────────────────────────────────────
 // Data Logging Functions (Public)
 //────────────────────────────────────────────────────────────
 
-void writeVoltammogramToFile() {
-    File file = SPIFFS.open("/data.csv", FILE_WRITE);
-    if (!file) {
+// Writes a sweep to `path` row by row in the given format.
+static bool writeVoltammogram(const SweepBuffer& sweep, const char* path, VoltammogramFormat format) {
+    FILE* file = halOpenFile(path, "wb");
+    if (file == NULL) {
         if (debugLevel) {
-            Serial.println("Error opening /data.csv for writing");
+            halLogf("Error opening %s for writing", path);
         }
-        return;
+        return false;
     }
-    // --- Modification: change header to indicate current is in microAmps ---
-    file.println("Index,Current_uA,Voltage_V,Time_ms");
-    for (uint16_t i = 0; i < number_of_valid_points_in_volts_amps_array; i++) {
-        file.print(i);
-        file.print(",");
-        file.print(amps[i], DEC);
-        file.print(",");
-        file.print((float)volts[i] / 1000.0, 3);
-        file.print(",");
-        file.println(time_Voltammaogram[i] - time_Voltammaogram[0]);
-    }
-    file.close();
-    if (debugLevel) {
-        Serial.println("Voltammogram data saved to /data.csv");
+    char line[VOLTAMMOGRAM_ROW_MAX_LEN];
+    VoltammogramCursor cursor = {0, 0};
+    while (cursor.row <= sweep.numPoints) {
+        size_t n = formatVoltammogramRow(sweep, format, cursor, line, sizeof(line));
+        fwrite(line, 1, n, file);
+    }
+    fclose(file);
+    return true;
+}
+
+void writeVoltammogramToFile(const SweepBuffer& sweep) {
+    if (writeVoltammogram(sweep, "/data.csv", VOLTAMMOGRAM_CSV) && debugLevel) {
+        halLogf("Voltammogram data saved to /data.csv");
+    }
+}
+
+void writeVoltammogramBinaryToFile(const SweepBuffer& sweep) {
+    if (writeVoltammogram(sweep, "/data.bin", VOLTAMMOGRAM_BINARY) && debugLevel) {
+        halLogf("Voltammogram data saved to /data.bin");
+    }
+}
+
+void writeVoltammogramToConsole(const SweepBuffer& sweep) {
+    char line[VOLTAMMOGRAM_ROW_MAX_LEN];
+    VoltammogramCursor cursor = {0, 0};
+    while (cursor.row <= sweep.numPoints) {
+        size_t n = formatVoltammogramRow(sweep, VOLTAMMOGRAM_CSV, cursor, line, sizeof(line));
+        halConsoleWrite((const uint8_t*)line, n);
     }
 }
 
 void readFileAndSendOverSerial() {
-    File file = SPIFFS.open("/data.csv", FILE_READ);
-    if (!file) {
+    FILE* file = halOpenFile("/data.csv", "rb");
+    if (file == NULL) {
         if (debugLevel) {
-            Serial.println("Error opening /data.csv for reading");
+            halLogf("Error opening /data.csv for reading");
         }
         return;
     }
     if (debugLevel) {
-        Serial.println("Reading /data.csv:");
+        halLogf("Reading /data.csv:");
     }
-    while (file.available()) {
-        Serial.write(file.read());
+    uint8_t chunk[128];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        halConsoleWrite(chunk, n);
     }
-    file.close();
+    fclose(file);
 }
 
 void clearVoltammogramFile() {
-    File file = SPIFFS.open("/data.csv", FILE_WRITE);
-    if (!file) {
+    FILE* file = halOpenFile("/data.csv", "wb");
+    if (file == NULL) {
         if (debugLevel) {
-            Serial.println("Error clearing /data.csv");
+            halLogf("Error clearing /data.csv");
         }
         return;
     }
-    file.close();
+    fclose(file);
     if (debugLevel) {
-        Serial.println("/data.csv cleared");
+        halLogf("/data.csv cleared");
     }
 }
 
-void clearVoltammogramArrays() {
-    reset_Voltammogram_arrays();
-    arr_cur_index = 0;
-    number_of_valid_points_in_volts_amps_array = 0;
-    if (debugLevel) {
-        Serial.println("Voltammogram arrays cleared");
+//────────────────────────────────────────────────────────────
+// Sweep Observers (Public)
+//────────────────────────────────────────────────────────────
+
+bool addVoltammogramListener(const VoltammogramListener* listener) {
+    if (numListeners >= maxListeners)
+        return false;
+    listeners[numListeners++] = listener;
+    if (listener->onPoint)
+        numPointListeners++;
+    return true;
+}
+
+bool updatePeakCalibration(const PeakCalibration& calibration) {
+    if (!peakCalibrationValid(calibration)) {
+        if (debugLevel) {
+            halLogf("Peak calibration rejected.");
+        }
+        return false;
+    }
+    SettingsUpdate update = {};
+    update.hasCalibration = true;
+    update.calibration = calibration;
+    return queueUpdate(update);
+}
+
+PeakCalibration getPeakCalibration() {
+    return requested.hasCalibration ? requested.calibration : peakCalibration;
+}
+
+bool updateDspConfig(const DspConfig& config) {
+    const char* error = dspConfigValidate(config);
+    if (error != NULL) {
+        if (debugLevel) {
+            halLogf("DSP configuration rejected: %s", error);
+        }
+        return false;
+    }
+    SettingsUpdate update = {};
+    update.hasDsp = true;
+    update.dsp = config;
+    return queueUpdate(update);
+}
+
+DspConfig getDspConfig() {
+    return requested.hasDsp ? requested.dsp : dspConfig;
+}
+
+bool updateAutoRange(const AutoRangeConfig& config) {
+    if (!autoRangeValid(config)) {
+        if (debugLevel) {
+            halLogf("Auto-range configuration rejected.");
+        }
+        return false;
+    }
+    SettingsUpdate update = {};
+    update.hasRange = true;
+    update.range = config;
+    return queueUpdate(update);
+}
+
+AutoRangeConfig getAutoRange() {
+    return requested.hasRange ? requested.range : autoRange;
+}
+
+void pstatApplySettings() {
+    SettingsUpdate update = {};
+    SettingsUpdate next;
+    while (settingsToApply.pop(next))
+        mergeUpdate(update, next);
+    if (!update.hasCalibration && !update.hasDsp && !update.hasRange && !update.adcChannels)
+        return;
+
+    if (update.hasCalibration)
+        peakCalibration = update.calibration;
+    if (update.hasDsp)
+        dspConfig = update.dsp;
+    if (update.hasRange) {
+        autoRange = update.range;
+        numRangeMemos = 0;
+        nextRangeMemo = 0;
+    }
+    uint8_t adcChanged = update.adcChannels;
+    for (uint8_t ch = 0; ch < HAL_MAX_CHANNELS; ch++) {
+        if (adcChanged & (1u << ch)) {
+            channels[ch].aCoeff = update.adc[ch].aCoeff;
+            channels[ch].bCoeff = update.adc[ch].bCoeff;
+        }
+    }
+    // The ADC calibrations are stored as one table, so the saver gets all of them.
+    if (adcChanged) {
+        for (uint8_t ch = 0; ch < HAL_MAX_CHANNELS; ch++) {
+            update.adc[ch].aCoeff = channels[ch].aCoeff;
+            update.adc[ch].bCoeff = channels[ch].bCoeff;
+        }
+        update.adcChannels = (uint8_t)((1u << HAL_MAX_CHANNELS) - 1);
+    }
+    if (!settingsToSave.push(update) && debugLevel) {
+        halLogf("Settings applied but not queued for saving.");
+    }
+
+    if (update.hasCalibration && debugLevel) {
+        halLogf("Peak calibration: slope %.6f, intercept %.6f%s",
+                peakCalibration.slope, peakCalibration.intercept,
+                peakCalibration.baselineCorrected ? ", baseline corrected" : "");
+    }
+    if (update.hasDsp && debugLevel) {
+        halLogf("DSP chain: median %u, smoothing %u over %u, baseline %u over %u edge points",
+                dspConfig.medianWindow, dspConfig.smoothing, dspConfig.smoothWindow,
+                dspConfig.baseline, dspConfig.edgePoints);
+    }
+    if (update.hasRange && debugLevel) {
+        halLogf("Auto-range %s: gain %u..%u, headroom %u codes, span %u codes, settle %lu us",
+                autoRange.enabled ? "on" : "off", autoRange.minGain, autoRange.maxGain,
+                autoRange.headroomCodes, autoRange.minSpanCodes, (unsigned long)autoRange.settleUs);
+    }
+    for (uint8_t ch = 0; ch < HAL_MAX_CHANNELS && debugLevel; ch++) {
+        if (adcChanged & (1u << ch)) {
+            halLogf("ADC calibration of channel %u: a %.3f, b %.3f", ch, channels[ch].aCoeff,
+                    channels[ch].bCoeff);
+        }
     }
 }
 
+void pstatSaveSettings() {
+    SettingsUpdate update = {};
+    SettingsUpdate next;
+    while (settingsToSave.pop(next))
+        mergeUpdate(update, next);
+    if (update.hasCalibration &&
+        !halConfigStore(peakCalibrationKey, &update.calibration, sizeof(update.calibration)) &&
+        debugLevel) {
+        halLogf("Peak calibration not persisted.");
+    }
+    if (update.hasDsp && !halConfigStore(dspConfigKey, &update.dsp, sizeof(update.dsp)) && debugLevel) {
+        halLogf("DSP configuration not persisted.");
+    }
+    if (update.hasRange && !halConfigStore(autoRangeKey, &update.range, sizeof(update.range)) &&
+        debugLevel) {
+        halLogf("Auto-range configuration not persisted.");
+    }
+    if (update.adcChannels && !halConfigStore(adcCalibrationKey, update.adc, sizeof(update.adc)) &&
+        debugLevel) {
+        halLogf("ADC calibration not persisted.");
+    }
+}
+
+int64_t pstatFirstSampleUs() {
+    return firstSampleUs;
+}
+
 //────────────────────────────────────────────────────────────
 // Debug Control Functions (Public)
 //────────────────────────────────────────────────────────────
@@ -329,7 +1117,7 @@ void clearVoltammogramArrays() {
 void setPstatDebug(bool on) {
     debugLevel = on;
     if (debugLevel) {
-        Serial.println("pstat debug enabled.");
+        halLogf("pstat debug enabled.");
     }
 }
 
@@ -342,36 +1130,76 @@ bool pstatDebugEnabled() {
 //────────────────────────────────────────────────────────────
 
 void updatePstatGain(uint8_t newGain) {
-    LMPgainGLOBAL = newGain;
-    pstatInit(newGain);
-    if (debugLevel) {
-        Serial.print("Pstat gain updated to: ");
-        Serial.println(newGain);
-    }
+    updateChannelGain(0, newGain);
 }
 
 uint8_t getPstatGain() {
-    return LMPgainGLOBAL;
+    return channels[0].gain;
 }
 
 void updatePstatBias(uint8_t newBias) {
-    bias_setting = newBias;
-    pStat.setBias(newBias);
+    channels[0].bias = newBias;
+    halSelectChannel(0);
+    halLmpSetBias(newBias, 0);
     if (debugLevel) {
-        Serial.print("Pstat bias updated to: ");
-        Serial.println(newBias);
+        halLogf("Pstat bias updated to: %u", newBias);
     }
 }
 
 uint8_t getPstatBias() {
-    return bias_setting;
+    return channels[0].bias;
+}
+
+uint8_t pstatChannelCount() {
+    return halChannelCount();
+}
+
+void updateChannelGain(uint8_t channel, uint8_t newGain) {
+    if (channel >= halChannelCount())
+        return;
+    channels[channel].gain = newGain;
+    initChannel(channel);
+    halDacWrite(0);
+    halSelectChannel(0);
+    if (debugLevel) {
+        halLogf("Pstat gain of channel %u updated to: %u", channel, newGain);
+    }
+}
+
+uint8_t getChannelGain(uint8_t channel) {
+    return channel < HAL_MAX_CHANNELS ? channels[channel].gain : 0;
+}
+
+bool updateChannelCalibration(uint8_t channel, const AdcCalibration& calibration) {
+    if (channel >= halChannelCount() || !adcCalibrationValid(calibration)) {
+        if (debugLevel) {
+            halLogf("ADC calibration of channel %u rejected.", channel);
+        }
+        return false;
+    }
+    SettingsUpdate update = {};
+    update.adcChannels = (uint8_t)(1u << channel);
+    update.adc[channel] = calibration;
+    return queueUpdate(update);
+}
+
+AdcCalibration getChannelCalibration(uint8_t channel) {
+    if (channel >= HAL_MAX_CHANNELS)
+        channel = 0;
+    if (requested.adcChannels & (1u << channel))
+        return requested.adc[channel];
+    AdcCalibration calibration = {channels[channel].aCoeff, channels[channel].bCoeff};
+    return calibration;
 }
 
 void updateAdcAverages(int newAverage) {
+    if (newAverage < 1)
+        newAverage = 1;
+    else if (newAverage > HAL_ADC_MAX_WINDOW)
+        newAverage = HAL_ADC_MAX_WINDOW;
     num_adc_readings_to_average = newAverage;
     if (debugLevel) {
-        Serial.print("ADC averaging updated to: ");
-        Serial.println(newAverage);
+        halLogf("ADC averaging updated to: %d", newAverage);
     }
 }
 
@@ -385,25 +1213,11 @@ int getAdcAverages() {
 
 // Renamed from initLMP to pstatInit to avoid conflict with the library.
 void pstatInit(uint8_t newGain) {
-    pStat.setMENB(MENB);     // Enable the LMP91000 via the MENB pin.
-    delay(50);
-    pStat.standby();         // Put the device into standby mode.
-    delay(50);
-
-    // Continue with the rest of the initialization.
-    pStat.disableFET();
-    pStat.setGain(newGain);
-    pStat.setRLoad(0);
-    pStat.setExtRefSource();
-    pStat.setIntZ(1);
-    pStat.setThreeLead();
-    pStat.setBias(0);
-    pStat.setPosBias();
-    setOutputsToZero();
-
-    LMPgainGLOBAL = newGain;
+    loadSettings();
+    channels[0].gain = newGain;
+    initChannel(0);
+    halDacWrite(0);
     if (debugLevel) {
-        Serial.print("pstatInit: pstat initialized with gain ");
-        Serial.println(newGain);
+        halLogf("pstatInit: pstat initialized with gain %u", newGain);
     }
 }
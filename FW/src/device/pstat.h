@@ -1,36 +1,170 @@
 #ifndef PSTAT_H
 #define PSTAT_H
 
-#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "sweep_buffer.h"
+#include "voltammogram.h"
+#include "peak_analysis.h"
+#include "dsp_chain.h"
 
-// Initializes the pstat module for SWV operation.
+// Initializes the pstat module for SWV operation and loads the persisted
+// calibration, DSP and auto-range settings. Call it once, before the tasks
+// and the server that use pstat start.
 // newGain: gain setting for the LMP91000 (for example, 7 for 350 kΩ)
 void pstatInit(uint8_t newGain);
 
-// Runs SWV (Square Wave Voltammetry) using the provided parameters.
+// Runs SWV (Square Wave Voltammetry) using the provided parameters and
+// records the result into out.
 // newGain: gain setting, startV: starting voltage (mV), endV: ending voltage (mV),
 // pulseAmp: square wave amplitude (mV), stepV: voltage increment (mV),
 // freq: square wave frequency (Hz), setToZero: if true, resets outputs at end.
-void runSWV(uint8_t newGain, int16_t startV, int16_t endV,
+// Returns false if the parameters are invalid or the sweep would not fit the
+// sample buffers.
+bool runSWV(SweepBuffer& out, uint8_t newGain, int16_t startV, int16_t endV,
             int16_t pulseAmp, int16_t stepV, double freq, bool setToZero);
 
-// Debug control functions.
+// Adaptive sweep: a coarse pass from startV to endV in coarseStepV
+// increments (rounded up to a multiple of stepV), then a pass in stepV
+// increments over windowMv on either side of the coarse peak. The passes are
+// merged into one voltammogram in sweep order, on the stepV grid: coarse
+// points outside the window, fine points inside it, each at its own
+// potential and sampling time (SweepBuffer::pointUs). The summary is
+// recomputed over the merged points. Listeners see the passes as two sweeps.
+// Falls back to runSWV() if coarseStepV is not larger than stepV or windowMv
+// is not positive; keeps the coarse sweep if it has no peak (PEAK_FLAG_NO_PEAK
+// or PEAK_FLAG_EDGE) or the fine pass fails.
+bool runAdaptiveSWV(SweepBuffer& out, uint8_t newGain, int16_t startV, int16_t endV,
+                    int16_t pulseAmp, int16_t stepV, int16_t coarseStepV, int16_t windowMv,
+                    double freq, bool setToZero);
+
+// Multi-sensor sweep: runs the sweep on every front-end channel in
+// channelMask (bit n = channel n) at once, recording channel n into out[n].
+// The channels share the reference DAC, so they follow the same waveform in
+// lockstep; within each half-period they are biased and sampled one after
+// another, and the half-period is stretched to fit them all. Each channel
+// uses its own gain and ADC calibration, gets its own sweep ID and peak
+// summary. Listeners observe the lowest channel in the mask. Returns false if
+// a channel is missing or has no buffer, or for the same reasons as runSWV().
+bool runSWVChannels(SweepBuffer* const out[], uint8_t channelMask, int16_t startV, int16_t endV,
+                    int16_t pulseAmp, int16_t stepV, double freq, bool setToZero);
+
+// SweepBuffer::sweepId of the next sweep; IDs count up from there. Seed it
+// from the sweep log at startup so IDs stay unique across reboots.
+void setNextSweepId(uint32_t sweepId);
+
+// Sweep observers. Callbacks run on the sampling task between half-periods,
+// so they must return quickly and must not block on I/O. Any callback may be NULL.
+// Points are those of the sweep's first channel, which the start and end
+// calls name along with its SweepBuffer::sweepId.
+struct VoltammogramListener {
+    void (*onSweepStart)(uint32_t sweepId, uint8_t channel, uint16_t numPoints);
+    void (*onPoint)(uint16_t index, int16_t voltage, float current, int32_t timeUs);
+    void (*onSweepEnd)(uint32_t sweepId, uint8_t channel, uint16_t numPoints);
+};
+
+// Every sweep is analysed while it runs; the result is stored in
+// SweepBuffer::summary using this calibration line. Updates are queued and
+// persisted like those of the DSP chain below, and survive a reboot. Returns
+// false if the slope is zero or either value is not finite, or if too many
+// updates are waiting for the next sweep.
+bool updatePeakCalibration(const PeakCalibration& calibration);
+PeakCalibration getPeakCalibration();
+
+// Noise reduction applied to every following sweep (see dsp_chain.h). Its
+// output is stored per point in SweepBuffer::filteredPa, which the exports
+// and the peak summary then use; listeners still get the raw currents.
+// Updates never block: they are queued, take effect when the next sweep
+// starts, and are persisted by pstatSaveSettings() after that. Updates and
+// getters belong to one task (the HTTP server's); the getter includes queued
+// updates. Returns false, keeping the current configuration, if it is
+// invalid or too many updates are waiting for the next sweep.
+bool updateDspConfig(const DspConfig& config);
+DspConfig getDspConfig();
+
+// Automatic gain ranging of the following sweeps. While a sweep runs, a
+// channel whose forward or reverse code comes within headroomCodes of an
+// ADC rail drops one gain step and the point is sampled again. After a few
+// points in a row that deflect less than minSpanCodes from the zero-current
+// code, and would stay clear of the rails at the next gain, it moves one
+// step up. Each change is followed by settleUs (rounded up to whole
+// half-periods) with the bias held, which shows up in the point's jitterUs.
+// Every point records its gain (SweepSample::gain), so conversion stays
+// exact. The lowest gain a sweep needed is remembered per channel and
+// start/end potential and replaces the gain passed in on the next sweep over
+// the same window; a configuration update clears what was remembered.
+// Updates are queued like those of the DSP chain.
+struct AutoRangeConfig {
+    bool enabled;
+    uint16_t headroomCodes;   // codes from either rail that count as saturated
+    uint16_t minSpanCodes;    // deflection below which a point is under-ranged
+    uint32_t settleUs;
+    uint8_t minGain;          // gain indices 1..7 the ranging may use
+    uint8_t maxGain;
+};
+
+const AutoRangeConfig AUTO_RANGE_OFF = {false, 64, 128, 2000, 1, 7};
+
+// Returns false, keeping the current configuration, if it is invalid.
+bool updateAutoRange(const AutoRangeConfig& config);
+AutoRangeConfig getAutoRange();
+
+// Takes over queued DSP and auto-range updates. Every sweep does so when it
+// starts; call it only from the task that runs the sweeps, between them.
+void pstatApplySettings();
+
+// Persists the DSP and auto-range updates taken over since the last call.
+// Writes flash, so it belongs on a task that may block, not on the sweeping
+// task or in an HTTP handler; one task at a time.
+void pstatSaveSettings();
+
+// halTimeUs() of the first ADC sample since boot, 0 before it; for the
+// wake-to-first-sample time of duty-cycled sweeps.
+int64_t pstatFirstSampleUs();
+
+// Registers a listener for all following sweeps. Returns false if the
+// listener table is full.
+bool addVoltammogramListener(const VoltammogramListener* listener);
+
+// Debug control functions. With debug on, every sample is traced through
+// trace_log.h; the records are printed by whoever drains the trace log.
 void setPstatDebug(bool on);
 bool pstatDebugEnabled();
 
-// Data logging functions.
-void writeVoltammogramToFile();
+// Data logging functions (conversion and row formatting live in voltammogram.h).
+void writeVoltammogramToFile(const SweepBuffer& sweep);         // "/data.csv"
+void writeVoltammogramBinaryToFile(const SweepBuffer& sweep);   // "/data.bin"
 void readFileAndSendOverSerial();
+void writeVoltammogramToConsole(const SweepBuffer& sweep);     // CSV, no file
 void clearVoltammogramFile();
-void clearVoltammogramArrays();
 
-// Public helper functions for pstat settings.
+// Public helper functions for pstat settings. The single-channel calls act
+// on channel 0.
 void updatePstatGain(uint8_t newGain);
 uint8_t getPstatGain();
 
 void updatePstatBias(uint8_t newBias);
 uint8_t getPstatBias();
 
+// Per-channel settings; runSWV() sets the gain of channel 0 itself.
+uint8_t pstatChannelCount();
+void updateChannelGain(uint8_t channel, uint8_t newGain);
+uint8_t getChannelGain(uint8_t channel);
+
+// ADC code -> voltage calibration of one channel (see adcToCurrent()).
+// Updates are queued and persisted like those of the DSP chain. Returns
+// false if the channel does not exist, either coefficient is not finite or
+// bCoeff is zero, or too many updates are waiting for the next sweep.
+struct AdcCalibration {
+    float aCoeff;
+    float bCoeff;
+};
+bool updateChannelCalibration(uint8_t channel, const AdcCalibration& calibration);
+AdcCalibration getChannelCalibration(uint8_t channel);
+
+// Samples averaged per half-period (1..1024). With DMA capture this is the
+// burst window captured at each pacer tick (see halAdcBegin()); takes
+// effect on the next sweep.
 void updateAdcAverages(int newAverage);
 int getAdcAverages();
 
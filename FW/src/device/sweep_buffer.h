@@ -0,0 +1,72 @@
+#ifndef SWEEP_BUFFER_H
+#define SWEEP_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Maximum number of points in one sweep.
+const uint16_t SWEEP_MAX_POINTS = 5000;
+
+// One recorded point: raw ADC codes as sampled; conversion to µA happens
+// only when the sweep is exported.
+struct SweepSample {
+    uint16_t step;        // step index: potential = startV + step * stepV
+    uint16_t adcForward;  // ADC code at the end of the forward half-period
+    uint16_t adcReverse;  // ADC code at the end of the reverse half-period
+    int16_t jitterUs;     // time since the previous point minus one period (saturated)
+    uint8_t gain;         // LMP91000 gain index the point was sampled at
+};
+
+// Quality flags of a PeakSummary.
+enum PeakFlags {
+    PEAK_FLAG_EDGE       = 0x01,   // maximum at the first or last point: no real peak
+    PEAK_FLAG_NO_PEAK    = 0x02,   // peak not above the baseline
+    PEAK_FLAG_SATURATED  = 0x04,   // an ADC code hit the end of its range
+    PEAK_FLAG_TIMING     = 0x08,   // half-periods were overrun during the sweep
+    PEAK_FLAG_CLAMPED    = 0x10,   // concentration clamped to its valid range
+    PEAK_FLAG_SHORT      = 0x20    // too few points for interpolation and baseline
+};
+
+// Peak and concentration of a sweep, computed on the device while it runs
+// (see peak_analysis.h).
+struct PeakSummary {
+    uint16_t peakIndex;        // point with the largest net current
+    float peakMv;              // interpolated peak potential (mV)
+    float peakUa;              // interpolated peak current (µA)
+    float baselineUa;          // linear baseline at peakMv (µA)
+    float heightUa;            // peakUa - baselineUa
+    float concentration;       // after the calibration line
+    uint8_t flags;             // PeakFlags
+};
+
+// Results of one sweep plus everything needed to export it. Sweeps are
+// recorded into a buffer owned by the caller, so a finished sweep can be
+// exported while the next one is recorded into another buffer. The sample
+// array is sized to the sweep plan and reused while it is large enough; a
+// zero-initialized buffer is ready to use.
+struct SweepBuffer {
+    uint32_t sweepId;
+    uint8_t channel;           // front end the sweep was recorded on
+    uint16_t numPoints;
+    uint16_t capacity;         // allocated samples
+    uint8_t gain;              // LMP91000 gain index at the start (see SweepSample::gain)
+    int16_t startV;            // mV
+    int16_t stepV;             // mV, negative for descending sweeps
+    int16_t pulseAmp;          // mV
+    uint32_t halfPeriodUs;
+    int32_t firstPointUs;      // time of point 0 since sweep start
+    float aCoeff;              // ADC calibration in effect
+    float bCoeff;
+    PeakSummary summary;       // valid once the sweep has finished
+    SweepSample* samples;
+    int32_t* filteredPa;       // DSP chain output per point (pA), or NULL; exported instead of the raw codes
+    int32_t* pointUs;          // time of each point since sweep start, or NULL to follow jitterUs;
+                               // set for adaptive sweeps, whose passes were sampled one after the other
+};
+
+// Potential (mV) of point i.
+inline int16_t sweepPointV(const SweepBuffer& sweep, uint16_t i) {
+    return sweep.startV + (int16_t)(sweep.samples[i].step * sweep.stepV);
+}
+
+#endif // SWEEP_BUFFER_H
@@ -0,0 +1,161 @@
+#include "sweep_jobs.h"
+#include "sweep_plan.h"
+#include "../hal/hal.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+static const uint16_t maxRepeat = 1000;
+
+static QueueHandle_t highQueue = NULL;
+static QueueHandle_t normalQueue = NULL;
+
+// Status of the latest jobs. A new job takes a free slot, else the one of the
+// oldest finished job; slots of queued and running jobs are never reused.
+// Written by the submitting task and the acquisition task, read by the web
+// server.
+static SweepJobStatus history[SWEEP_JOB_HISTORY];
+static uint32_t nextJobId = 1;
+static portMUX_TYPE historyLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* stateNames[] = {"queued", "running", "done", "failed"};
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+// Slot of a job in the history; the caller holds historyLock.
+static SweepJobStatus* findJob(uint32_t id) {
+    for (uint8_t i = 0; i < SWEEP_JOB_HISTORY && id != 0; i++) {
+        if (history[i].id == id)
+            return &history[i];
+    }
+    return NULL;
+}
+
+static bool finished(const SweepJobStatus& status) {
+    return status.state == JOB_DONE || status.state == JOB_FAILED;
+}
+
+// Slot for a new job, or NULL if every slot holds a queued or running job.
+// The caller holds historyLock.
+static SweepJobStatus* freeSlot() {
+    SweepJobStatus* oldest = NULL;
+    for (uint8_t i = 0; i < SWEEP_JOB_HISTORY; i++) {
+        SweepJobStatus& slot = history[i];
+        if (slot.id == 0)
+            return &slot;
+        if (finished(slot) && (oldest == NULL || slot.id < oldest->id))
+            oldest = &slot;
+    }
+    return oldest;
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+void sweepJobsInit() {
+    if (highQueue == NULL)
+        highQueue = xQueueCreate(SWEEP_JOB_QUEUE_LEN, sizeof(SweepJob));
+    if (normalQueue == NULL)
+        normalQueue = xQueueCreate(SWEEP_JOB_QUEUE_LEN, sizeof(SweepJob));
+}
+
+const char* sweepJobValidate(const SweepJobSpec& spec) {
+    if (spec.gain > 7)
+        return "gain must be 0..7";
+    if (!(spec.freq > 0))
+        return "freq must be positive";
+    if (spec.repeat == 0 || spec.repeat > maxRepeat)
+        return "repeat must be 1..1000";
+    if (spec.stepV == 0)
+        return "step must be non-zero";
+    int16_t maxMv = sweepPlanMaxMv();
+    if (abs(spec.startV) + abs(spec.pulseAmp) > maxMv || abs(spec.endV) + abs(spec.pulseAmp) > maxMv)
+        return "start and end +/- pulseAmp must stay within the bias range (+/-792 mV)";
+    if (sweepPlanPointCount(spec.startV, spec.endV, spec.stepV) > SWEEP_MAX_POINTS)
+        return "sweep has more than 5000 points";
+    if (spec.coarseStepV != 0 && (abs(spec.coarseStepV) <= abs(spec.stepV) || spec.windowMv <= 0))
+        return "coarseStep must exceed step, with a positive window";
+    if (spec.channels == 0 || (spec.channels >> halChannelCount()) != 0)
+        return "channels must select fitted front ends";
+    if (spec.coarseStepV != 0 && spec.channels != 0x01)
+        return "adaptive sweeps run on channel 0 only";
+    return NULL;
+}
+
+uint32_t sweepJobSubmit(const SweepJobSpec& spec) {
+    SweepJob job;
+    job.spec = spec;
+    portENTER_CRITICAL(&historyLock);
+    SweepJobStatus* slot = freeSlot();
+    if (slot == NULL) {
+        portEXIT_CRITICAL(&historyLock);
+        return 0;
+    }
+    job.id = nextJobId++;
+    if (nextJobId == 0)
+        nextJobId = 1;
+    *slot = SweepJobStatus();
+    slot->id = job.id;
+    slot->state = JOB_QUEUED;
+    slot->spec = spec;
+    portEXIT_CRITICAL(&historyLock);
+
+    QueueHandle_t queue = spec.priority ? highQueue : normalQueue;
+    if (xQueueSend(queue, &job, 0) != pdTRUE) {
+        portENTER_CRITICAL(&historyLock);
+        if (SweepJobStatus* status = findJob(job.id))
+            status->id = 0;
+        portEXIT_CRITICAL(&historyLock);
+        return 0;
+    }
+    return job.id;
+}
+
+bool sweepJobNext(SweepJob& job, TickType_t wait) {
+    if (xQueueReceive(highQueue, &job, 0) != pdTRUE &&
+        xQueueReceive(normalQueue, &job, wait) != pdTRUE)
+        return false;
+    portENTER_CRITICAL(&historyLock);
+    if (SweepJobStatus* status = findJob(job.id))
+        status->state = JOB_RUNNING;
+    portEXIT_CRITICAL(&historyLock);
+    return true;
+}
+
+void sweepJobSweepDone(uint32_t id, const SweepBuffer& sweep) {
+    portENTER_CRITICAL(&historyLock);
+    if (SweepJobStatus* status = findJob(id)) {
+        status->completed++;
+        status->lastSweepId = sweep.sweepId;
+        status->last = sweep.summary;
+    }
+    portEXIT_CRITICAL(&historyLock);
+}
+
+void sweepJobFinish(uint32_t id, bool ok) {
+    portENTER_CRITICAL(&historyLock);
+    if (SweepJobStatus* status = findJob(id))
+        status->state = ok ? JOB_DONE : JOB_FAILED;
+    portEXIT_CRITICAL(&historyLock);
+}
+
+bool sweepJobStatus(uint32_t id, SweepJobStatus& status) {
+    portENTER_CRITICAL(&historyLock);
+    SweepJobStatus* found = findJob(id);
+    if (found != NULL)
+        status = *found;
+    portEXIT_CRITICAL(&historyLock);
+    return found != NULL;
+}
+
+uint8_t sweepJobsPending() {
+    return uxQueueMessagesWaiting(highQueue) + uxQueueMessagesWaiting(normalQueue);
+}
+
+const char* sweepJobStateName(SweepJobState state) {
+    return stateNames[state];
+}
@@ -0,0 +1,83 @@
+#ifndef SWEEP_JOBS_H
+#define SWEEP_JOBS_H
+
+#include <Arduino.h>
+#include "sweep_buffer.h"
+
+// Queue of parameterized sweep jobs. Jobs are submitted from any task (the
+// web server), held in two bounded FreeRTOS queues (high and normal
+// priority) and run back to back by the acquisition task. The status of
+// the most recent jobs stays available by ID after they finish.
+
+// Jobs waiting per priority level, and status slots shared by queued,
+// running and finished jobs.
+const uint8_t SWEEP_JOB_QUEUE_LEN = 8;
+const uint8_t SWEEP_JOB_HISTORY = 16;
+
+struct SweepJobSpec {
+    uint8_t gain;          // TIA gain index
+    int16_t startV;        // mV
+    int16_t endV;          // mV
+    int16_t pulseAmp;      // mV
+    int16_t stepV;         // mV
+    float freq;            // Hz
+    uint16_t repeat;       // sweeps to run
+    uint8_t priority;      // 0 = normal, anything else = ahead of normal jobs
+    int16_t coarseStepV;   // mV; non-zero runs an adaptive sweep (see runAdaptiveSWV())
+    int16_t windowMv;      // fine window on either side of the coarse peak
+    uint8_t channels;      // front ends swept together, bit n = channel n (see runSWVChannels());
+                           // adaptive sweeps run on channel 0 only
+};
+
+// The protocol that used to be hard-coded in main.cpp.
+const SweepJobSpec SWEEP_JOB_DEFAULT = {7, -200, 200, 20, 5, 10.0f, 1, 0, 0, 0, 0x01};
+
+enum SweepJobState : uint8_t {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED
+};
+
+struct SweepJob {
+    uint32_t id;
+    SweepJobSpec spec;
+};
+
+struct SweepJobStatus {
+    uint32_t id;
+    SweepJobState state;
+    SweepJobSpec spec;
+    uint16_t completed;     // sweeps finished so far
+    uint32_t lastSweepId;   // SweepBuffer::sweepId of the latest sweep
+    PeakSummary last;       // its peak summary
+};
+
+// Creates the queues. Call once before any other function.
+void sweepJobsInit();
+
+// Checks a spec; returns NULL if it can run, otherwise the reason.
+const char* sweepJobValidate(const SweepJobSpec& spec);
+
+// Queues a validated job and returns its ID, or 0 if its queue is full or
+// no history slot is free (all held by queued or running jobs).
+uint32_t sweepJobSubmit(const SweepJobSpec& spec);
+
+// Acquisition side: takes the next job, high priority first, waiting up to
+// `wait` ticks. Marks it running.
+bool sweepJobNext(SweepJob& job, TickType_t wait);
+
+// Acquisition side: records one finished sweep of a job (for a multi-channel
+// job, that of its lowest channel), and the end of it.
+void sweepJobSweepDone(uint32_t id, const SweepBuffer& sweep);
+void sweepJobFinish(uint32_t id, bool ok);
+
+// Status of a job still in the history; false if the ID is unknown.
+bool sweepJobStatus(uint32_t id, SweepJobStatus& status);
+
+// Jobs waiting in both queues.
+uint8_t sweepJobsPending();
+
+const char* sweepJobStateName(SweepJobState state);
+
+#endif // SWEEP_JOBS_H
@@ -0,0 +1,409 @@
+#include "sweep_log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../hal/hal.h"
+#include "voltammogram.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+static const char* metaKey = "swlog";
+static const char* watermarkKey = "swlogmark";
+static const char recordMagic[4] = {'S', 'W', 'L', 'R'};
+
+// Record header in the segment file, followed by `len` SWVB bytes. Stored
+// in the CPU's (little-endian) byte order.
+struct RecordHeader {
+    char magic[4];
+    uint32_t sweepId;
+    uint32_t timeS;
+    uint32_t len;
+    uint32_t crc;          // CRC-32 of the payload
+};
+
+// One index entry per record, in the segment's .idx file.
+struct IndexEntry {
+    uint32_t sweepId;
+    uint32_t timeS;
+    uint32_t offset;
+};
+
+// Persisted range of live segment numbers: [first, next).
+struct LogMeta {
+    uint32_t firstSegment;
+    uint32_t nextSegment;
+};
+
+struct Segment {
+    uint32_t number;
+    uint32_t firstId;
+    uint32_t lastId;
+    uint32_t minTime;
+    uint32_t maxTime;
+    uint32_t count;        // index entries
+    uint32_t bytes;        // segment file size
+};
+
+static bool ready = false;
+static LogMeta meta = {0, 0};
+static Segment segments[SWEEP_LOG_MAX_SEGMENTS];   // oldest first
+static uint8_t numSegments = 0;
+static uint32_t watermark = 0;
+static uint32_t droppedUnsent = 0;
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+// CRC-32 (IEEE), four bits at a time.
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ data[i]) & 0x0F];
+        crc = (crc >> 4) ^ table[(crc ^ (data[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+static void segmentPath(char* path, size_t size, uint32_t number, const char* ext) {
+    snprintf(path, size, "/swlog_%lu.%s", (unsigned long)number, ext);
+}
+
+static FILE* openSegmentFile(uint32_t number, const char* ext, const char* mode) {
+    char path[32];
+    segmentPath(path, sizeof(path), number, ext);
+    return halOpenFile(path, mode);
+}
+
+static long fileSize(FILE* file) {
+    if (fseek(file, 0, SEEK_END) != 0)
+        return -1;
+    return ftell(file);
+}
+
+static void removeSegmentFiles(uint32_t number) {
+    char path[32];
+    segmentPath(path, sizeof(path), number, "seg");
+    halRemoveFile(path);
+    segmentPath(path, sizeof(path), number, "idx");
+    halRemoveFile(path);
+}
+
+static bool readIndexEntry(FILE* idx, uint32_t pos, IndexEntry& entry) {
+    return fseek(idx, (long)pos * sizeof(IndexEntry), SEEK_SET) == 0 &&
+           fread(&entry, sizeof(entry), 1, idx) == 1;
+}
+
+// Rebuilds a segment's table entry from its files; false if it holds nothing.
+static bool loadSegment(uint32_t number, Segment& seg) {
+    seg = Segment();
+    seg.number = number;
+    FILE* data = openSegmentFile(number, "seg", "rb");
+    if (data == NULL)
+        return false;
+    long bytes = fileSize(data);
+    fclose(data);
+
+    FILE* idx = openSegmentFile(number, "idx", "rb");
+    if (idx == NULL)
+        return false;
+    long idxBytes = fileSize(idx);
+    seg.bytes = bytes > 0 ? bytes : 0;
+    seg.count = idxBytes > 0 ? idxBytes / sizeof(IndexEntry) : 0;
+
+    IndexEntry entry;
+    fseek(idx, 0, SEEK_SET);
+    for (uint32_t i = 0; i < seg.count; i++) {
+        if (fread(&entry, sizeof(entry), 1, idx) != 1) {
+            seg.count = i;
+            break;
+        }
+        if (i == 0) {
+            seg.firstId = entry.sweepId;
+            seg.minTime = seg.maxTime = entry.timeS;
+        }
+        seg.lastId = entry.sweepId;
+        if (entry.timeS < seg.minTime)
+            seg.minTime = entry.timeS;
+        if (entry.timeS > seg.maxTime)
+            seg.maxTime = entry.timeS;
+    }
+    fclose(idx);
+    return seg.count > 0;
+}
+
+// Position of the first index entry with sweepId >= id (count if none).
+static uint32_t lowerBound(const Segment& seg, FILE* idx, uint32_t id) {
+    uint32_t lo = 0, hi = seg.count;
+    IndexEntry entry;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (!readIndexEntry(idx, mid, entry))
+            return seg.count;
+        if (entry.sweepId < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// First entry of a segment with sweepId >= id.
+static bool findFrom(const Segment& seg, uint32_t id, SweepLogEntry& out) {
+    FILE* idx = openSegmentFile(seg.number, "idx", "rb");
+    if (idx == NULL)
+        return false;
+    uint32_t pos = lowerBound(seg, idx, id);
+    IndexEntry entry;
+    bool found = pos < seg.count && readIndexEntry(idx, pos, entry);
+    fclose(idx);
+    if (!found)
+        return false;
+    out.sweepId = entry.sweepId;
+    out.timeS = entry.timeS;
+    out.segment = seg.number;
+    out.offset = entry.offset;
+    return true;
+}
+
+static void storeMeta() {
+    halConfigStore(metaKey, &meta, sizeof(meta));
+}
+
+static void dropOldestSegment() {
+    Segment& oldest = segments[0];
+    if (oldest.lastId > watermark) {
+        uint32_t from = watermark + 1 > oldest.firstId ? watermark + 1 : oldest.firstId;
+        FILE* idx = openSegmentFile(oldest.number, "idx", "rb");
+        if (idx != NULL) {
+            droppedUnsent += oldest.count - lowerBound(oldest, idx, from);
+            fclose(idx);
+        }
+    }
+    removeSegmentFiles(oldest.number);
+
+    memmove(&segments[0], &segments[1], (numSegments - 1) * sizeof(Segment));
+    numSegments--;
+    meta.firstSegment = numSegments > 0 ? segments[0].number : meta.nextSegment;
+}
+
+static Segment* startSegment() {
+    if (numSegments == SWEEP_LOG_MAX_SEGMENTS)
+        dropOldestSegment();
+    Segment& seg = segments[numSegments];
+    seg = Segment();
+    seg.number = meta.nextSegment;
+    FILE* data = openSegmentFile(seg.number, "seg", "wb");
+    FILE* idx = openSegmentFile(seg.number, "idx", "wb");
+    bool ok = data != NULL && idx != NULL;
+    if (data != NULL)
+        fclose(data);
+    if (idx != NULL)
+        fclose(idx);
+    if (!ok)
+        return NULL;
+
+    if (numSegments == 0)
+        meta.firstSegment = seg.number;
+    meta.nextSegment++;
+    storeMeta();
+    numSegments++;
+    return &seg;
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+bool sweepLogBegin() {
+    numSegments = 0;
+    if (!halConfigLoad(metaKey, &meta, sizeof(meta)))
+        meta = LogMeta();
+    if (!halConfigLoad(watermarkKey, &watermark, sizeof(watermark)))
+        watermark = 0;
+
+    // Only the newest SWEEP_LOG_MAX_SEGMENTS numbers can still exist.
+    uint32_t first = meta.firstSegment;
+    if (meta.nextSegment - first > SWEEP_LOG_MAX_SEGMENTS)
+        first = meta.nextSegment - SWEEP_LOG_MAX_SEGMENTS;
+    for (uint32_t n = first; n != meta.nextSegment; n++) {
+        if (loadSegment(n, segments[numSegments]))
+            numSegments++;
+        else
+            removeSegmentFiles(n);   // empty, or left half-created
+    }
+    meta.firstSegment = numSegments > 0 ? segments[0].number : meta.nextSegment;
+
+    // Check that the filesystem takes writes at all.
+    FILE* probe = halOpenFile("/swlog.probe", "wb");
+    ready = probe != NULL;
+    if (probe != NULL) {
+        fclose(probe);
+        halRemoveFile("/swlog.probe");
+    }
+    return ready;
+}
+
+bool sweepLogReady() {
+    return ready;
+}
+
+uint32_t sweepLogLastId() {
+    return numSegments > 0 ? segments[numSegments - 1].lastId : 0;
+}
+
+bool sweepLogAppend(const SweepBuffer& sweep) {
+    if (!ready || sweep.sweepId <= sweepLogLastId())
+        return false;
+
+    Segment* seg = numSegments > 0 ? &segments[numSegments - 1] : NULL;
+    if (seg == NULL || seg->bytes >= SWEEP_LOG_SEGMENT_BYTES)
+        seg = startSegment();
+    if (seg == NULL)
+        return false;
+
+    FILE* data = openSegmentFile(seg->number, "seg", "r+b");
+    if (data == NULL)
+        return false;
+    fseek(data, seg->bytes, SEEK_SET);
+
+    // Header first with the length and CRC unknown, patched once the
+    // payload is written; a torn record fails its CRC on read.
+    RecordHeader header;
+    memcpy(header.magic, recordMagic, sizeof(header.magic));
+    header.sweepId = sweep.sweepId;
+    header.timeS = (uint32_t)time(NULL);
+    header.len = 0;
+    header.crc = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, data) == 1;
+
+    char row[VOLTAMMOGRAM_ROW_MAX_LEN];
+    VoltammogramCursor cursor = {0, 0};
+    while (ok && cursor.row <= sweep.numPoints) {
+        size_t n = formatVoltammogramRow(sweep, VOLTAMMOGRAM_BINARY, cursor, row, sizeof(row));
+        ok = fwrite(row, 1, n, data) == n;
+        header.crc = crc32Update(header.crc, (const uint8_t*)row, n);
+        header.len += n;
+    }
+    ok = ok && fseek(data, seg->bytes, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, data) == 1;
+    fclose(data);
+    if (!ok)
+        return false;
+
+    IndexEntry entry = {header.sweepId, header.timeS, seg->bytes};
+    FILE* idx = openSegmentFile(seg->number, "idx", "ab");
+    if (idx == NULL)
+        return false;
+    ok = fwrite(&entry, sizeof(entry), 1, idx) == 1;
+    fclose(idx);
+    if (!ok)
+        return false;
+
+    if (seg->count == 0) {
+        seg->firstId = entry.sweepId;
+        seg->minTime = seg->maxTime = entry.timeS;
+    }
+    seg->lastId = entry.sweepId;
+    if (entry.timeS < seg->minTime)
+        seg->minTime = entry.timeS;
+    if (entry.timeS > seg->maxTime)
+        seg->maxTime = entry.timeS;
+    seg->count++;
+    seg->bytes += sizeof(header) + header.len;
+    return true;
+}
+
+bool sweepLogFind(uint32_t sweepId, SweepLogEntry& entry) {
+    for (uint8_t i = 0; i < numSegments; i++) {
+        const Segment& seg = segments[i];
+        if (sweepId >= seg.firstId && sweepId <= seg.lastId)
+            return findFrom(seg, sweepId, entry) && entry.sweepId == sweepId;
+    }
+    return false;
+}
+
+bool sweepLogFindTime(uint32_t timeS, SweepLogEntry& entry) {
+    for (uint8_t i = 0; i < numSegments; i++) {
+        const Segment& seg = segments[i];
+        if (seg.maxTime < timeS)
+            continue;
+        FILE* idx = openSegmentFile(seg.number, "idx", "rb");
+        if (idx == NULL)
+            continue;
+        IndexEntry e;
+        for (uint32_t pos = 0; pos < seg.count && readIndexEntry(idx, pos, e); pos++) {
+            if (e.timeS >= timeS) {
+                fclose(idx);
+                entry.sweepId = e.sweepId;
+                entry.timeS = e.timeS;
+                entry.segment = seg.number;
+                entry.offset = e.offset;
+                return true;
+            }
+        }
+        fclose(idx);
+    }
+    return false;
+}
+
+bool sweepLogNextUnsent(SweepLogEntry& entry) {
+    for (uint8_t i = 0; i < numSegments; i++) {
+        if (segments[i].lastId > watermark)
+            return findFrom(segments[i], watermark + 1, entry);
+    }
+    return false;
+}
+
+uint8_t* sweepLogRead(const SweepLogEntry& entry, size_t& len) {
+    len = 0;
+    FILE* data = openSegmentFile(entry.segment, "seg", "rb");
+    if (data == NULL)
+        return NULL;
+    RecordHeader header;
+    uint8_t* payload = NULL;
+    if (fseek(data, entry.offset, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, data) == 1 &&
+        memcmp(header.magic, recordMagic, sizeof(header.magic)) == 0 &&
+        header.sweepId == entry.sweepId && header.len <= SWEEP_LOG_SEGMENT_BYTES + sizeof(header)) {
+        payload = (uint8_t*)malloc(header.len);
+        if (payload != NULL &&
+            (fread(payload, 1, header.len, data) != header.len ||
+             crc32Update(0, payload, header.len) != header.crc)) {
+            free(payload);
+            payload = NULL;
+        }
+    }
+    fclose(data);
+    if (payload != NULL)
+        len = header.len;
+    return payload;
+}
+
+void sweepLogMarkUploaded(uint32_t sweepId) {
+    if (sweepId <= watermark)
+        return;
+    watermark = sweepId;
+    halConfigStore(watermarkKey, &watermark, sizeof(watermark));
+}
+
+uint32_t sweepLogWatermark() {
+    return watermark;
+}
+
+void getSweepLogStats(SweepLogStats& stats) {
+    stats = SweepLogStats();
+    stats.firstId = numSegments > 0 ? segments[0].firstId : 0;
+    stats.lastId = sweepLogLastId();
+    stats.watermark = watermark;
+    stats.segments = numSegments;
+    stats.droppedUnsent = droppedUnsent;
+    for (uint8_t i = 0; i < numSegments; i++) {
+        stats.sweeps += segments[i].count;
+        stats.bytes += segments[i].bytes;
+    }
+}
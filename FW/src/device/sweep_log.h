@@ -0,0 +1,67 @@
+#ifndef SWEEP_LOG_H
+#define SWEEP_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sweep_buffer.h"
+
+// Append-only store-and-forward log of sweeps on the data filesystem.
+// Sweeps are stored as SWVB payloads in a ring of segment files
+// ("/swlog_<n>.seg"), each with a small fixed-width index file
+// ("/swlog_<n>.idx") for seeking by sweep ID or time. When the ring is full
+// the oldest segment is deleted, so flash use and wear are bounded. An
+// upload watermark (the newest sweep ID delivered in order) is kept in the
+// settings store, so after an outage only unsent sweeps are replayed.
+//
+// Sweep IDs must increase across reboots; seed pstat with
+// setNextSweepId(sweepLogLastId() + 1) at startup. Not thread safe: use the
+// log from a single task.
+
+const uint8_t SWEEP_LOG_MAX_SEGMENTS = 8;
+const uint32_t SWEEP_LOG_SEGMENT_BYTES = 96 * 1024;
+
+struct SweepLogEntry {
+    uint32_t sweepId;
+    uint32_t timeS;        // time() when appended; counts from boot unless the clock was set
+    uint32_t segment;
+    uint32_t offset;       // of the record header within the segment file
+};
+
+struct SweepLogStats {
+    uint32_t firstId;      // oldest sweep still stored (0 if empty)
+    uint32_t lastId;
+    uint32_t watermark;
+    uint32_t sweeps;
+    uint32_t bytes;
+    uint8_t segments;
+    uint32_t droppedUnsent;   // unsent sweeps lost to segment rotation since boot
+};
+
+// Loads the segment table and the watermark. Returns false if the storage
+// cannot be used; every other call then fails.
+bool sweepLogBegin();
+bool sweepLogReady();
+
+uint32_t sweepLogLastId();
+
+// Appends a sweep. Fails for IDs not above sweepLogLastId().
+bool sweepLogAppend(const SweepBuffer& sweep);
+
+// Exact lookup by ID, and the first sweep logged at or after timeS.
+bool sweepLogFind(uint32_t sweepId, SweepLogEntry& entry);
+bool sweepLogFindTime(uint32_t timeS, SweepLogEntry& entry);
+
+// Oldest stored sweep above the watermark.
+bool sweepLogNextUnsent(SweepLogEntry& entry);
+
+// Reads the SWVB payload of an entry into a malloc()ed buffer the caller
+// frees. Returns NULL if the record is unreadable or fails its CRC.
+uint8_t* sweepLogRead(const SweepLogEntry& entry, size_t& len);
+
+// Advances the watermark to sweepId (never backwards).
+void sweepLogMarkUploaded(uint32_t sweepId);
+uint32_t sweepLogWatermark();
+
+void getSweepLogStats(SweepLogStats& stats);
+
+#endif // SWEEP_LOG_H
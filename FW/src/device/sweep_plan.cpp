@@ -0,0 +1,96 @@
+#include "sweep_plan.h"
+#include <stdlib.h>
+#include "../hal/lmp91000_tables.h"
+
+//────────────────────────────────────────────────────────────
+// Static Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+static const uint16_t opVolt = 3300;       // Operating voltage (mV)
+static const uint16_t dacResolution = 255; // 8-bit DAC: 2^8 - 1
+static const uint16_t minDACVoltage = 1520;
+static const uint16_t zeroDACVoltage = 1500;
+
+static inline uint8_t convertDACVoutToDACVal(uint16_t dacVout) {
+    return (uint8_t)(dacVout * ((float)dacResolution / opVolt));
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+// Picks the smallest TIA_BIAS[] fraction that can reach the requested
+// magnitude with the DAC below opVolt. Potentials under 7.5 mV map to zero
+// bias; 7.5-15 mV are rounded up to 15 mV, the smallest settable value.
+PulseSetting resolvePulseSetting(int16_t voltage) {
+    PulseSetting s;
+    s.mV = voltage;
+    s.sign = (voltage < 0) ? -1 : (voltage > 0 ? 1 : 0);
+    s.biasIndex = 0;
+    s.dacVout = zeroDACVoltage;
+
+    int16_t magnitude = abs(voltage);
+    if (magnitude < 15) {
+        if (magnitude > 7.5)
+            magnitude = 15;
+        else {
+            s.dacCode = convertDACVoutToDACVal(s.dacVout);
+            return s;
+        }
+    }
+
+    s.dacVout = minDACVoltage;
+    for (uint8_t i = 1; i < NUM_TIA_BIAS; i++) {
+        s.biasIndex = i;
+        float dacVout = magnitude / TIA_BIAS[i];
+        if (dacVout <= opVolt) {
+            s.dacVout = (uint16_t)dacVout;
+            break;
+        }
+        // Out of range at the largest bias: saturate.
+        s.dacVout = opVolt;
+    }
+    s.dacCode = convertDACVoutToDACVal(s.dacVout);
+    return s;
+}
+
+int16_t sweepPlanMaxMv() {
+    return (int16_t)(TIA_BIAS[NUM_TIA_BIAS - 1] * opVolt);
+}
+
+uint32_t sweepPlanPointCount(int16_t startV, int16_t endV, int16_t stepV) {
+    if (stepV == 0)
+        return 0;
+    return (uint32_t)abs((int32_t)endV - startV) / abs(stepV) + 1;
+}
+
+bool buildSweepPlan(SweepPlan& plan, int16_t startV, int16_t endV,
+                    int16_t pulseAmp, int16_t stepV, uint16_t maxPoints) {
+    plan.pulses = NULL;
+    plan.numPoints = 0;
+    plan.startV = startV;
+
+    uint32_t numPoints = sweepPlanPointCount(startV, endV, stepV);
+    if (numPoints == 0 || numPoints > maxPoints)
+        return false;
+    stepV = abs(stepV);
+    pulseAmp = abs(pulseAmp);
+
+    plan.stepV = (startV < endV) ? stepV : -stepV;
+    plan.pulses = (PulseSetting*)malloc(2 * numPoints * sizeof(PulseSetting));
+    if (plan.pulses == NULL)
+        return false;
+    plan.numPoints = numPoints;
+
+    for (uint16_t i = 0; i < plan.numPoints; i++) {
+        int16_t j = sweepPlanStepV(plan, i);
+        plan.pulses[2 * i] = resolvePulseSetting(j + pulseAmp);
+        plan.pulses[2 * i + 1] = resolvePulseSetting(j - pulseAmp);
+    }
+    return true;
+}
+
+void freeSweepPlan(SweepPlan& plan) {
+    free(plan.pulses);
+    plan.pulses = NULL;
+    plan.numPoints = 0;
+}
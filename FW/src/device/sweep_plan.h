@@ -0,0 +1,51 @@
+#ifndef SWEEP_PLAN_H
+#define SWEEP_PLAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Everything needed to apply one half-period of the square wave.
+struct PulseSetting {
+    int16_t mV;          // desired cell potential (mV)
+    int8_t sign;         // -1 negative bias, +1 positive bias, 0 leave unchanged
+    uint8_t biasIndex;   // index into TIA_BIAS[]
+    uint8_t dacCode;     // 8-bit DAC code for Vref
+    uint16_t dacVout;    // DAC output (mV) the code corresponds to
+};
+
+// Precomputed SWV sweep: one forward and one reverse pulse per step, in the
+// order they are applied. Built once per runSWV() so the sampling loop only
+// walks the table.
+struct SweepPlan {
+    int16_t startV;      // potential of step 0 (mV)
+    int16_t stepV;       // signed increment between steps (mV)
+    uint16_t numPoints;  // number of voltammogram points (steps)
+    PulseSetting* pulses; // 2 * numPoints entries: forward, reverse, forward, ...
+};
+
+// Resolves the bias index, sign and DAC code for a single potential.
+PulseSetting resolvePulseSetting(int16_t voltage);
+
+// Largest cell potential magnitude (mV) the LMP91000 bias can reach: the
+// largest bias fraction of a Vref at the supply voltage.
+int16_t sweepPlanMaxMv();
+
+// Number of points a sweep from startV to endV (inclusive) in stepV
+// increments has; 0 if stepV is 0.
+uint32_t sweepPlanPointCount(int16_t startV, int16_t endV, int16_t stepV);
+
+// Builds the plan for a sweep from startV towards endV (inclusive) in stepV
+// increments with a +/- pulseAmp square wave. Returns false if the plan would
+// hold more than maxPoints points or could not be allocated.
+bool buildSweepPlan(SweepPlan& plan, int16_t startV, int16_t endV,
+                    int16_t pulseAmp, int16_t stepV, uint16_t maxPoints);
+
+// Releases the pulse table of a plan.
+void freeSweepPlan(SweepPlan& plan);
+
+// Potential (mV) of a given step.
+inline int16_t sweepPlanStepV(const SweepPlan& plan, uint16_t step) {
+    return plan.startV + (int16_t)(step * plan.stepV);
+}
+
+#endif // SWEEP_PLAN_H
@@ -0,0 +1,63 @@
+#include "trace_log.h"
+#include <stdio.h>
+#include "../hal/hal.h"
+#include "../hal/lmp91000_tables.h"
+#include "../util/spsc_queue.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables (Private to this module)
+//────────────────────────────────────────────────────────────
+
+static SpscQueue<TraceRecord, TRACE_LOG_SLOTS> ring;
+static volatile uint32_t droppedRecords = 0;
+static uint32_t reportedDrops = 0;   // consumer side: drops already announced
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+void traceLogPush(const TraceRecord& record) {
+    if (!ring.push(record))
+        droppedRecords++;
+}
+
+bool traceLogPop(TraceRecord& record) {
+    return ring.pop(record);
+}
+
+size_t traceLogFormat(const TraceRecord& record, char* buf, size_t len) {
+    int n;
+    if (record.type == TRACE_POINT_END) {
+        n = snprintf(buf, len, "EOL");
+    } else {
+        float setMv = record.dacVout * TIA_BIAS[record.biasIndex < NUM_TIA_BIAS ? record.biasIndex : 0];
+        n = snprintf(buf, len, "%lu\tDesired V: %d\tSet V: %.2f\tDAC: %u\tADC: %u\tI: %.4f",
+                     (unsigned long)record.timeUs, record.desiredMv, setMv, record.dacVout,
+                     record.adc, record.currentUa);
+    }
+    if (n < 0 || (size_t)n >= len)
+        return 0;
+    return n;
+}
+
+size_t traceLogDrainText(size_t maxRecords) {
+    uint32_t drops = droppedRecords;
+    if (drops != reportedDrops) {
+        halLogf("trace: %lu records dropped", (unsigned long)(drops - reportedDrops));
+        reportedDrops = drops;
+    }
+
+    char line[96];
+    TraceRecord record;
+    size_t printed = 0;
+    while (printed < maxRecords && ring.pop(record)) {
+        if (traceLogFormat(record, line, sizeof(line)) > 0)
+            halLogf("%s", line);
+        printed++;
+    }
+    return printed;
+}
+
+uint32_t getTraceLogDropped() {
+    return droppedRecords;
+}
@@ -0,0 +1,46 @@
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Low-overhead trace of the sampling loop. The hot path only copies a
+// fixed-size binary record into a lock-free ring; a low-priority task drains
+// the ring and does any text formatting, so tracing can stay on without
+// shifting the sample timing. Records that do not fit are dropped and counted.
+
+enum TraceRecordType {
+    TRACE_SAMPLE    = 0,   // one half-period sample
+    TRACE_POINT_END = 1    // forward and reverse samples of a point done
+};
+
+struct TraceRecord {
+    uint32_t timeUs;       // halTimeUs() at the sample (wraps after ~71 min)
+    int16_t desiredMv;     // requested cell potential
+    uint16_t dacVout;      // DAC output (mV)
+    uint16_t adc;          // averaged ADC code
+    uint8_t type;          // TraceRecordType
+    uint8_t biasIndex;     // index into TIA_BIAS[]; set potential = dacVout * TIA_BIAS[biasIndex]
+    float currentUa;       // converted current
+};
+
+// Ring capacity in records (one slot stays empty).
+const uint16_t TRACE_LOG_SLOTS = 512;
+
+// Producer side (sampling task only). Never blocks.
+void traceLogPush(const TraceRecord& record);
+
+// Consumer side (one task only). Pops a record; false if the ring is empty.
+bool traceLogPop(TraceRecord& record);
+
+// Pops up to maxRecords records and prints them as text lines through
+// halLogf(). Returns the number printed.
+size_t traceLogDrainText(size_t maxRecords);
+
+// Formats one record as a text line (without line ending).
+size_t traceLogFormat(const TraceRecord& record, char* buf, size_t len);
+
+// Records dropped because the ring was full.
+uint32_t getTraceLogDropped();
+
+#endif // TRACE_LOG_H
@@ -0,0 +1,122 @@
+#include "voltammogram.h"
+#include <math.h>
+#include <stdio.h>
+#include "sweep_plan.h"
+#include "voltammogram_format.h"
+
+uint16_t currentToAdc(float currentUa, uint16_t dacVout, uint8_t gain, float a, float b) {
+    float tia = (gain == 0) ? 1e6f : (float)TIA_GAIN[gain - 1];
+    float v1 = (dacVout * 0.5f + currentUa * tia / 1000.0f) / 1000.0f;   // V
+    float code = a + 2.0f * b * v1 * (255.0f / 3.3f);
+    if (code < 0.0f)
+        return 0;
+    if (code > 4095.0f)
+        return 4095;
+    return (uint16_t)lroundf(code);
+}
+
+float getSweepPointCurrent(const SweepBuffer& sweep, uint16_t i) {
+    if (sweep.filteredPa != NULL)
+        return sweep.filteredPa[i] * 1e-6f;
+    const SweepSample& sample = sweep.samples[i];
+    int16_t v = sweepPointV(sweep, i);
+    uint16_t dacForward = resolvePulseSetting(v + sweep.pulseAmp).dacVout;
+    uint16_t dacReverse = resolvePulseSetting(v - sweep.pulseAmp).dacVout;
+    return adcToCurrent(sample.adcForward, dacForward, sample.gain, sweep.aCoeff, sweep.bCoeff) -
+           adcToCurrent(sample.adcReverse, dacReverse, sample.gain, sweep.aCoeff, sweep.bCoeff);
+}
+
+// Time of point i relative to point 0, given the time of point i - 1.
+static inline int32_t advancePointTime(const SweepBuffer& sweep, uint16_t i, int32_t prevUs) {
+    if (sweep.pointUs != NULL)
+        return sweep.pointUs[i] - sweep.pointUs[0];
+    if (i == 0)
+        return 0;
+    return prevUs + 2 * (int32_t)sweep.halfPeriodUs + sweep.samples[i].jitterUs;
+}
+
+static size_t formatCsvRow(const SweepBuffer& sweep, const VoltammogramCursor& cursor,
+                           char* buf, size_t len) {
+    int n;
+    if (cursor.row == 0) {
+        // Current is reported in microAmps.
+        n = snprintf(buf, len, "Index,Current_uA,Voltage_V,Time_ms\r\n");
+    } else {
+        uint16_t i = cursor.row - 1;
+        n = snprintf(buf, len, "%u,%.10f,%.3f,%.3f\r\n", i, getSweepPointCurrent(sweep, i),
+                     sweepPointV(sweep, i) / 1000.0, cursor.timeUs / 1000.0);
+    }
+    if (n < 0 || (size_t)n >= len)
+        return 0;
+    return n;
+}
+
+static size_t formatBinaryRow(const SweepBuffer& sweep, const VoltammogramCursor& cursor,
+                              char* buf, size_t len) {
+    uint8_t* out = (uint8_t*)buf;
+    if (cursor.row == 0) {
+        if (len < SWVB_HEADER_LEN)
+            return 0;
+        SwvbHeader header;
+        header.channel = sweep.channel;
+        header.gain = sweep.gain;
+        header.numPoints = sweep.numPoints;
+        header.startV = sweep.startV;
+        header.stepV = sweep.stepV;
+        header.pulseAmp = sweep.pulseAmp;
+        header.halfPeriodUs = sweep.halfPeriodUs;
+        header.currentLsbPa = SWVB_CURRENT_LSB_PA;
+        header.aCoeff = sweep.aCoeff;
+        header.bCoeff = sweep.bCoeff;
+        header.tiaGainOhms = (sweep.gain == 0) ? 0 : TIA_GAIN[sweep.gain - 1];
+        return swvbEncodeHeader(header, out);
+    }
+
+    uint16_t i = cursor.row - 1;
+    if (len < SWVB_RECORD_MAX_LEN)
+        return 0;
+    int16_t v = sweepPointV(sweep, i);
+    int16_t prevV = (i == 0) ? sweep.startV : sweepPointV(sweep, i - 1);
+    int32_t period = 2 * sweep.halfPeriodUs;
+    int32_t dt;
+    if (sweep.pointUs != NULL)
+        dt = sweep.pointUs[i] - (i == 0 ? 0 : sweep.pointUs[i - 1]) - period;
+    else
+        dt = (i == 0) ? sweep.firstPointUs - period : sweep.samples[i].jitterUs;
+    // µA -> pA -> LSB
+    int32_t current = lroundf(getSweepPointCurrent(sweep, i) * (1e6f / SWVB_CURRENT_LSB_PA));
+
+    size_t n = swvbEncodeVarint(v - prevV - sweep.stepV, out);
+    n += swvbEncodeVarint(current, out + n);
+    n += swvbEncodeVarint(dt, out + n);
+    return n;
+}
+
+static size_t formatSummary(const SweepBuffer& sweep, char* buf, size_t len) {
+    const PeakSummary& s = sweep.summary;
+    int n = snprintf(buf, len,
+                     "{\"sweepId\":%lu,\"channel\":%u,\"points\":%u,\"peakV\":%.4f,\"peakUa\":%.6f,"
+                     "\"baselineUa\":%.6f,\"heightUa\":%.6f,\"concentration\":%.2f,\"flags\":%u}",
+                     (unsigned long)sweep.sweepId, sweep.channel, sweep.numPoints, s.peakMv / 1000.0, s.peakUa,
+                     s.baselineUa, s.heightUa, s.concentration, s.flags);
+    if (n < 0 || (size_t)n >= len)
+        return 0;
+    return n;
+}
+
+size_t formatVoltammogramRow(const SweepBuffer& sweep, VoltammogramFormat format,
+                             VoltammogramCursor& cursor, char* buf, size_t len) {
+    if (cursor.row > sweep.numPoints)
+        return 0;
+    if (format == VOLTAMMOGRAM_SUMMARY) {
+        cursor.row = sweep.numPoints + 1;
+        return formatSummary(sweep, buf, len);
+    }
+    if (cursor.row > 0)
+        cursor.timeUs = advancePointTime(sweep, cursor.row - 1, cursor.timeUs);
+
+    size_t n = (format == VOLTAMMOGRAM_BINARY) ? formatBinaryRow(sweep, cursor, buf, len)
+                                               : formatCsvRow(sweep, cursor, buf, len);
+    cursor.row++;
+    return n;
+}
@@ -0,0 +1,55 @@
+#ifndef VOLTAMMOGRAM_H
+#define VOLTAMMOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sweep_buffer.h"
+#include "../hal/lmp91000_tables.h"
+
+// Conversion and export of recorded sweeps. Pure computation: no hardware
+// access, so it also builds for the host benchmarks.
+
+// Longest row formatVoltammogramRow() produces in any format, including the
+// line ending.
+const size_t VOLTAMMOGRAM_ROW_MAX_LEN = 192;
+
+// ADC code -> µA for a half-period biased with dacVout (mV), given the TIA
+// gain index and the board's ADC calibration (a, b).
+static inline float adcToCurrent(uint16_t adc, uint16_t dacVout, uint8_t gain, float a, float b) {
+    float v1 = (3.3 / 255.0) * (1 / (2.0 * b)) * (float)adc - (a / (2.0 * b)) * (3.3 / 255.0);
+    v1 = v1 * 1000;
+    float v2 = dacVout * 0.5;
+    // Gain 0 selects the external 1 MΩ resistor; result is always in µA.
+    float tia = (gain == 0) ? 1e6 : TIA_GAIN[gain - 1];
+    return (((v1 - v2) / 1000) / tia) * 1e6;
+}
+
+// Inverse of adcToCurrent(), clamped to the 12-bit code range. Used to
+// synthesise ADC codes from currents (simulator, trace replay).
+uint16_t currentToAdc(float currentUa, uint16_t dacVout, uint8_t gain, float a, float b);
+
+// Current (µA) of point i: the DSP chain's output if the sweep has one,
+// otherwise converted from the raw ADC codes.
+float getSweepPointCurrent(const SweepBuffer& sweep, uint16_t i);
+
+// Export formats of a sweep.
+enum VoltammogramFormat {
+    VOLTAMMOGRAM_CSV,     // text, one row per point
+    VOLTAMMOGRAM_BINARY,  // SWVB, see voltammogram_format.h
+    VOLTAMMOGRAM_SUMMARY  // one JSON object with SweepBuffer::summary, no points
+};
+
+// Sequential export position. Start with {0, 0}; row 0 is the header and
+// rows 1..sweep.numPoints are points.
+struct VoltammogramCursor {
+    uint16_t row;       // next row to format
+    int32_t timeUs;     // time of the last formatted point relative to point 0
+};
+
+// Formats the row at the cursor into buf (CSV rows include the line ending)
+// and advances the cursor. A summary is a single row 0. Returns the row length, or 0 past the last row or
+// if the row does not fit.
+size_t formatVoltammogramRow(const SweepBuffer& sweep, VoltammogramFormat format,
+                             VoltammogramCursor& cursor, char* buf, size_t len);
+
+#endif // VOLTAMMOGRAM_H
@@ -0,0 +1,47 @@
+#include "voltammogram_format.h"
+#include <string.h>
+
+static inline uint8_t* putLE(uint8_t* p, uint32_t v, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++)
+        *p++ = (uint8_t)(v >> (8 * i));
+    return p;
+}
+
+static inline uint8_t* putFloat(uint8_t* p, float f) {
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return putLE(p, v, 4);
+}
+
+size_t swvbEncodeHeader(const SwvbHeader& header, uint8_t* buf) {
+    uint8_t* p = buf;
+    *p++ = 'S';
+    *p++ = 'W';
+    *p++ = 'V';
+    *p++ = 'B';
+    *p++ = SWVB_VERSION;
+    *p++ = header.gain;
+    p = putLE(p, header.numPoints, 2);
+    p = putLE(p, (uint16_t)header.startV, 2);
+    p = putLE(p, (uint16_t)header.stepV, 2);
+    p = putLE(p, (uint16_t)header.pulseAmp, 2);
+    *p++ = header.channel;
+    *p++ = 0;
+    p = putLE(p, header.halfPeriodUs, 4);
+    p = putLE(p, header.currentLsbPa, 4);
+    p = putFloat(p, header.aCoeff);
+    p = putFloat(p, header.bCoeff);
+    p = putFloat(p, header.tiaGainOhms);
+    return p - buf;
+}
+
+size_t swvbEncodeVarint(int32_t value, uint8_t* buf) {
+    uint32_t zz = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    size_t n = 0;
+    while (zz >= 0x80) {
+        buf[n++] = (uint8_t)(zz | 0x80);
+        zz >>= 7;
+    }
+    buf[n++] = (uint8_t)zz;
+    return n;
+}
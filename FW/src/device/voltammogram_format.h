@@ -0,0 +1,61 @@
+#ifndef VOLTAMMOGRAM_FORMAT_H
+#define VOLTAMMOGRAM_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary voltammogram format ("SWVB"), version 2. All multi-byte header
+// fields are little-endian. Version 1 is the same layout with byte 14
+// reserved (0), so readers of version 2 can take both.
+//
+//   offset size  field
+//    0     4     magic "SWVB"
+//    4     1     version (2)
+//    5     1     LMP91000 gain index
+//    6     2     number of points (uint16)
+//    8     2     start potential, mV (int16)
+//   10     2     step, mV (int16, signed: negative for descending sweeps)
+//   12     2     pulse amplitude, mV (int16)
+//   14     1     front-end channel (version 2; 0 in version 1)
+//   15     1     reserved (0)
+//   16     4     half-period, µs (uint32)
+//   20     4     current LSB, pA (uint32)
+//   24     4     calibration a_coeff (float32)
+//   28     4     calibration b_coeff (float32)
+//   32     4     TIA gain, ohms (float32; 0 for the external resistor)
+//
+// followed by one record per point, each field a zigzag LEB128 varint:
+//   potential delta minus step (mV)          -- 0 for a regular sweep
+//   current in LSB units                     -- fixed point
+//   time delta minus one period (µs)         -- sampling jitter
+// The first point's deltas are taken against the start potential and t = 0.
+// Points are in sweep order; in an adaptive sweep the fine points were
+// sampled after the coarse ones, so time deltas at the window edges are
+// large and may be negative.
+
+const uint8_t SWVB_VERSION = 2;
+const size_t SWVB_HEADER_LEN = 36;
+const size_t SWVB_RECORD_MAX_LEN = 15;     // three 5-byte varints
+const uint32_t SWVB_CURRENT_LSB_PA = 10;   // 10 pA resolution
+
+struct SwvbHeader {
+    uint8_t channel;
+    uint8_t gain;
+    uint16_t numPoints;
+    int16_t startV;
+    int16_t stepV;
+    int16_t pulseAmp;
+    uint32_t halfPeriodUs;
+    uint32_t currentLsbPa;
+    float aCoeff;
+    float bCoeff;
+    float tiaGainOhms;
+};
+
+// Writes the 36-byte header. buf must hold SWVB_HEADER_LEN bytes.
+size_t swvbEncodeHeader(const SwvbHeader& header, uint8_t* buf);
+
+// Appends a zigzag varint; returns the number of bytes written (1-5).
+size_t swvbEncodeVarint(int32_t value, uint8_t* buf);
+
+#endif // VOLTAMMOGRAM_FORMAT_H
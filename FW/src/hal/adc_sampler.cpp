@@ -0,0 +1,128 @@
+#include "adc_sampler.h"
+#include <driver/i2s.h>
+#include <driver/adc.h>
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+// The built-in ADC can only be routed to I2S0.
+static const i2s_port_t adcPort = I2S_NUM_0;
+static const uint8_t dmaBufCount = 4;
+static const uint16_t minDmaBufLen = 8;     // keeps the DMA interrupt rate sane
+
+static bool installed = false;
+static bool running = false;
+static int8_t installedChannel = -1;
+static uint16_t dmaBufLen = 0;             // samples per DMA buffer
+static uint16_t windowLen = 0;             // samples averaged per read
+static uint16_t lastCode = 0;
+
+// One DMA buffer worth of raw samples.
+static uint16_t burst[ADC_WINDOW_MAX_SAMPLES];
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+static inline uint16_t dmaLenFor(uint16_t windowSamples) {
+    return windowSamples < minDmaBufLen ? minDmaBufLen : windowSamples;
+}
+
+static bool installDriver(int8_t channel, uint16_t bufLen) {
+    i2s_config_t config = {};
+    config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+    config.sample_rate = ADC_BURST_SAMPLE_RATE;
+    config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+    config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+    config.intr_alloc_flags = 0;
+    config.dma_buf_count = dmaBufCount;
+    config.dma_buf_len = bufLen;
+    config.use_apll = false;
+
+    if (i2s_driver_install(adcPort, &config, 0, NULL) != ESP_OK)
+        return false;
+    // Same 12-bit, 11 dB configuration analogRead() uses, so codes match.
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten((adc1_channel_t)channel, ADC_ATTEN_DB_11);
+    if (i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)channel) != ESP_OK) {
+        i2s_driver_uninstall(adcPort);
+        return false;
+    }
+    installed = true;
+    installedChannel = channel;
+    dmaBufLen = bufLen;
+    return true;
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+bool adcSamplerBegin(uint8_t pin, uint16_t windowSamples) {
+    if (running)
+        adcSamplerEnd();
+
+    // I2S ADC mode only drives ADC1 (channels 0-7).
+    int8_t channel = digitalPinToAnalogChannel(pin);
+    if (channel < 0 || channel > 7)
+        return false;
+
+    if (windowSamples == 0)
+        windowSamples = 1;
+    else if (windowSamples > ADC_WINDOW_MAX_SAMPLES)
+        windowSamples = ADC_WINDOW_MAX_SAMPLES;
+
+    // The driver is kept across sweeps and only reinstalled when the buffer
+    // geometry or the channel changes.
+    uint16_t bufLen = dmaLenFor(windowSamples);
+    if (installed && (bufLen != dmaBufLen || channel != installedChannel)) {
+        i2s_driver_uninstall(adcPort);
+        installed = false;
+    }
+    if (!installed && !installDriver(channel, bufLen))
+        return false;
+
+    windowLen = windowSamples;
+    if (i2s_adc_enable(adcPort) != ESP_OK)
+        return false;
+    running = true;
+    return true;
+}
+
+void adcSamplerEnd() {
+    if (!running)
+        return;
+    i2s_adc_disable(adcPort);
+    running = false;
+}
+
+uint16_t adcSamplerRead() {
+    if (!running)
+        return lastCode;
+
+    const size_t bufBytes = dmaBufLen * sizeof(uint16_t);
+    size_t n = 0;
+
+    // Drop buffers completed before the tick; the window is then the buffer
+    // being filled right now.
+    while (i2s_read(adcPort, burst, bufBytes, &n, 0) == ESP_OK && n == bufBytes) {
+    }
+
+    if (i2s_read(adcPort, burst, bufBytes, &n, pdMS_TO_TICKS(10) + 1) != ESP_OK || n != bufBytes)
+        return lastCode;
+
+    // Each word carries the channel in the top nibble and the code below it.
+    const uint16_t* window = burst + (dmaBufLen - windowLen);
+    uint32_t sum = 0;
+    for (uint16_t i = 0; i < windowLen; i++) {
+        sum += window[i] & 0x0FFF;
+    }
+    lastCode = (uint16_t)((sum + windowLen / 2) / windowLen);
+    return lastCode;
+}
+
+uint32_t adcSamplerWindowUs(uint16_t windowSamples) {
+    return (uint32_t)dmaLenFor(windowSamples) * 1000000UL / ADC_BURST_SAMPLE_RATE;
+}
@@ -0,0 +1,29 @@
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include <Arduino.h>
+
+// Burst sampling of the LMP91000 output through the ESP32's I2S built-in ADC
+// mode. The ADC free-runs into DMA buffers during a sweep; each read returns
+// the integer mean of a window of samples captured around the pacer tick,
+// so oversampling costs no CPU time between samples.
+
+const uint32_t ADC_BURST_SAMPLE_RATE = 200000;   // samples/s while capturing
+const uint16_t ADC_WINDOW_MAX_SAMPLES = 1024;    // I2S DMA buffer limit
+
+// Starts capturing from `pin` (must be an ADC1 pin) with a window of
+// windowSamples samples. Returns false if DMA capture is unavailable; the
+// caller should fall back to analogRead().
+bool adcSamplerBegin(uint8_t pin, uint16_t windowSamples);
+
+// Stops capturing and releases the ADC for analogRead().
+void adcSamplerEnd();
+
+// Mean ADC code (0..4095) of the first window completed after the call.
+// Blocks for at most one DMA buffer period.
+uint16_t adcSamplerRead();
+
+// Worst-case time (µs) adcSamplerRead() takes for a window of windowSamples.
+uint32_t adcSamplerWindowUs(uint16_t windowSamples);
+
+#endif // ADC_SAMPLER_H
@@ -0,0 +1,117 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Thin hardware abstraction for the sweep code. pstat and sweep_plan only
+// talk to the hardware through these calls, so they build unchanged for the
+// ESP32 (hal_esp32.cpp) and for a Linux host against a simulated
+// potentiostat (native/hal_native.cpp).
+
+// Largest ADC averaging window any backend accepts.
+const uint16_t HAL_ADC_MAX_WINDOW = 1024;
+
+// Most front-end channels a backend can drive.
+const uint8_t HAL_MAX_CHANNELS = 8;
+
+// Places a static variable where it survives halDeepSleep() (RTC slow
+// memory on the device). It is zeroed or initialized on power-on only, so
+// it must be trivially constructible.
+#ifdef ARDUINO
+#include <esp_attr.h>
+#define HAL_RETAINED RTC_DATA_ATTR
+#else
+#define HAL_RETAINED
+#endif
+
+//────────────────────────────────────────────────────────────
+// Timing
+//────────────────────────────────────────────────────────────
+
+// Monotonic time in µs.
+int64_t halTimeUs();
+void halDelayMs(uint32_t ms);
+
+// Sample pacer: a periodic tick every periodUs for the calling task.
+// halPacerWait() blocks until the next tick and returns the number of ticks
+// since the previous wait (more than 1 means half-periods were overrun).
+void halPacerStart(uint32_t periodUs);
+void halPacerStop();
+uint32_t halPacerWait();
+
+// Free-running CPU cycle counter (wraps) and its rate, for phase timing.
+uint32_t halCycleCount();
+uint32_t halCyclesPerUs();
+
+//────────────────────────────────────────────────────────────
+// Analog front end
+//────────────────────────────────────────────────────────────
+
+// Front-end channels: LMP91000s on one I2C bus (they share its address and
+// are told apart by their MENB pins), all referenced to the same DAC, each
+// with its own ADC input. The LMP and ADC calls below act on the selected
+// channel; channel 0 is selected at start.
+uint8_t halChannelCount();
+void halSelectChannel(uint8_t channel);
+
+// 8-bit DAC driving the external reference of every LMP91000.
+void halDacWrite(uint8_t code);
+
+// LMP91000 output. halAdcBegin() prepares reads of the channels in
+// channelMask averaging windowSamples samples each; it returns false if the
+// backend falls back to slower one-shot reads. halAdcWindowUs() is the
+// worst-case duration of one read, burst or one-shot.
+bool halAdcBegin(uint16_t windowSamples, uint8_t channelMask);
+void halAdcEnd();
+uint16_t halAdcRead();
+uint32_t halAdcWindowUs();
+
+// LMP91000 configuration for SWV: 3-lead amperometric cell, external
+// reference, 50 % internal zero, TIA gain index `gain` (0 = external
+// resistor), zero bias. Cheap when the chip is already configured so.
+void halLmpInit(uint8_t gain);
+
+// TIA gain index only, keeping the bias; for gain changes during a sweep.
+void halLmpSetGain(uint8_t gain);
+
+// Bias index into TIA_BIAS[] and sign (-1 negative, +1 positive, 0 keep),
+// applied together.
+void halLmpSetBias(uint8_t biasIndex, int8_t sign);
+
+// Data-point indicator LED.
+void halLedWrite(bool on);
+
+//────────────────────────────────────────────────────────────
+// Storage and console
+//────────────────────────────────────────────────────────────
+
+// Opens a file in the data filesystem; `path` is absolute within it
+// ("/data.csv"). Same modes as fopen().
+FILE* halOpenFile(const char* path, const char* mode);
+bool halRemoveFile(const char* path);
+
+// Small persistent settings (NVS on the device). Load returns false if the
+// key is missing or was stored with a different size.
+bool halConfigLoad(const char* key, void* data, size_t len);
+bool halConfigStore(const char* key, const void* data, size_t len);
+
+//────────────────────────────────────────────────────────────
+// Power
+//────────────────────────────────────────────────────────────
+
+// Puts the front ends and the CPU into deep sleep for `us` and reboots on
+// the timer. Only HAL_RETAINED variables keep their values. Does not return.
+void halDeepSleep(uint64_t us);
+
+// True if this boot is a wake from halDeepSleep() rather than a reset.
+bool halWokeFromSleep();
+
+// Raw bytes to the console (the serial port on the device).
+void halConsoleWrite(const uint8_t* data, size_t len);
+
+// printf-style line to the console.
+void halLogf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // HAL_H
@@ -0,0 +1,259 @@
+#include "hal.h"
+#include <Arduino.h>
+#include <stdarg.h>
+#include <Preferences.h>
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "lmp91000_driver.h"
+#include "adc_sampler.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+// Pin definitions (adjust as needed)
+static const uint8_t dacPin   = 25;    // DAC output pin for Vref
+static const int LEDPIN       = 26;    // LED pin (for data-point signaling)
+
+// Front-end channels: MENB pin of the LMP91000 and the ADC1 pin its Vout is
+// wired to. The front ends share SDA/SCL and the Vref DAC. GPIO16/17 are
+// taken by the PICO-D4's flash, so the extra MENB lines use 4, 13 and 27.
+// Sweep jobs select channels with SweepJobSpec::channels.
+struct ChannelPins {
+    uint8_t menb;
+    uint8_t adc;
+};
+static const ChannelPins channelPins[] = {
+    {5, 35},
+    {4, 34},
+    {13, 39},
+    {27, 36},
+};
+static const uint8_t numChannels = sizeof(channelPins) / sizeof(channelPins[0]);
+static uint8_t selectedChannel = 0;
+
+// LittleFS is mounted on the VFS under this prefix by LittleFS.begin().
+static const char* storageRoot = "/littlefs";
+static const char* configNamespace = "metallyze";
+
+static bool lmpPowered = false;
+
+// Sample pacing: a periodic esp_timer notifies the pacing task once per
+// period, so samples land on an absolute µs schedule independent of the
+// work done between them. The task's notification is reserved for the
+// pacer while it runs.
+static esp_timer_handle_t pacerTimer = NULL;
+static TaskHandle_t pacerTask = NULL;
+
+// ADC: DMA bursts when available, otherwise blocking analogRead() calls.
+// Bursts capture a single pin, so reads of several channels are one-shot.
+static bool adcBurst = false;
+static uint16_t adcWindow = 1;
+static const uint32_t oneShotReadUs = 12;   // one analogRead() on ADC1, rounded up
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+// Runs in the esp_timer task at every period boundary.
+static void onPacerTick(void* arg) {
+    xTaskNotifyGive(pacerTask);
+}
+
+// Integer mean of blocking reads.
+static inline uint16_t analog_read_avg(int num_points, int pin_num) {
+    uint32_t sum = 0;
+    for (int i = 0; i < num_points; i++) {
+        sum += analogRead(pin_num);
+    }
+    return (uint16_t)((sum + num_points / 2) / num_points);
+}
+
+//────────────────────────────────────────────────────────────
+// Timing
+//────────────────────────────────────────────────────────────
+
+int64_t halTimeUs() {
+    return esp_timer_get_time();
+}
+
+void halDelayMs(uint32_t ms) {
+    delay(ms);
+}
+
+void halPacerStart(uint32_t periodUs) {
+    if (pacerTimer == NULL) {
+        esp_timer_create_args_t args = {};
+        args.callback = &onPacerTick;
+        args.name = "swv_sample";
+        esp_timer_create(&args, &pacerTimer);
+    }
+    pacerTask = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);   // drop ticks left over from a previous run
+    esp_timer_start_periodic(pacerTimer, periodUs);
+}
+
+void halPacerStop() {
+    esp_timer_stop(pacerTimer);
+}
+
+uint32_t halPacerWait() {
+    return ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+uint32_t halCycleCount() {
+    return ESP.getCycleCount();
+}
+
+uint32_t halCyclesPerUs() {
+    return getCpuFrequencyMhz();
+}
+
+//────────────────────────────────────────────────────────────
+// Analog front end
+//────────────────────────────────────────────────────────────
+
+uint8_t halChannelCount() {
+    return numChannels;
+}
+
+void halSelectChannel(uint8_t channel) {
+    if (channel >= numChannels)
+        return;
+    selectedChannel = channel;
+    if (lmpPowered)
+        lmpDriverSelect(channel);
+}
+
+void halDacWrite(uint8_t code) {
+    dacWrite(dacPin, code);
+}
+
+bool halAdcBegin(uint16_t windowSamples, uint8_t channelMask) {
+    adcWindow = windowSamples == 0 ? 1 : windowSamples;
+    adcBurst = false;
+    // A single channel gets burst capture on its pin.
+    for (uint8_t ch = 0; ch < numChannels; ch++) {
+        if (channelMask == (1u << ch))
+            adcBurst = adcSamplerBegin(channelPins[ch].adc, adcWindow);
+    }
+    return adcBurst;
+}
+
+void halAdcEnd() {
+    adcSamplerEnd();
+    adcBurst = false;
+}
+
+uint16_t halAdcRead() {
+    if (adcBurst)
+        return adcSamplerRead();
+    return analog_read_avg(adcWindow, channelPins[selectedChannel].adc);
+}
+
+uint32_t halAdcWindowUs() {
+    return adcBurst ? adcSamplerWindowUs(adcWindow) : adcWindow * oneShotReadUs;
+}
+
+void halLmpInit(uint8_t gain) {
+    LmpConfig config;
+    config.tiacn = lmpTiacn(gain, 0);                              // 10 ohm load
+    config.refcn = lmpRefcn(true, LMP_INT_Z_50, false, 0);
+    config.modecn = lmpModecn(false, LMP_MODE_THREE_LEAD);         // FET short off
+    if (lmpDriverIsApplied(config))
+        return;
+
+    if (!lmpPowered) {
+        uint8_t menb[numChannels];
+        for (uint8_t ch = 0; ch < numChannels; ch++)
+            menb[ch] = channelPins[ch].menb;
+        lmpDriverBegin(menb, numChannels);
+        lmpDriverSelect(selectedChannel);
+        delay(50);               // power-up time after MENB goes low
+        lmpPowered = true;
+    }
+    lmpDriverApply(config);
+}
+
+void halLmpSetGain(uint8_t gain) {
+    lmpDriverSetGain(gain);
+}
+
+void halLmpSetBias(uint8_t biasIndex, int8_t sign) {
+    lmpDriverSetBias(biasIndex, sign);
+}
+
+void halLedWrite(bool on) {
+    digitalWrite(LEDPIN, on ? HIGH : LOW);
+}
+
+//────────────────────────────────────────────────────────────
+// Power
+//────────────────────────────────────────────────────────────
+
+void halDeepSleep(uint64_t us) {
+    // Front ends to their deep-sleep mode; halLmpInit() restores them after
+    // the wake, as their shadows do not survive it.
+    if (lmpPowered) {
+        for (uint8_t ch = 0; ch < numChannels; ch++) {
+            lmpDriverSelect(ch);
+            lmpDriverSetMode(LMP_MODE_DEEP_SLEEP);
+        }
+    }
+    halDacWrite(0);
+    digitalWrite(LEDPIN, LOW);
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup(us);
+    esp_deep_sleep_start();
+}
+
+bool halWokeFromSleep() {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+//────────────────────────────────────────────────────────────
+// Storage and console
+//────────────────────────────────────────────────────────────
+
+FILE* halOpenFile(const char* path, const char* mode) {
+    char fullPath[64];
+    snprintf(fullPath, sizeof(fullPath), "%s%s", storageRoot, path);
+    return fopen(fullPath, mode);
+}
+
+bool halRemoveFile(const char* path) {
+    char fullPath[64];
+    snprintf(fullPath, sizeof(fullPath), "%s%s", storageRoot, path);
+    return remove(fullPath) == 0;
+}
+
+bool halConfigLoad(const char* key, void* data, size_t len) {
+    Preferences prefs;
+    if (!prefs.begin(configNamespace, true))
+        return false;
+    bool ok = prefs.getBytesLength(key) == len && prefs.getBytes(key, data, len) == len;
+    prefs.end();
+    return ok;
+}
+
+bool halConfigStore(const char* key, const void* data, size_t len) {
+    Preferences prefs;
+    if (!prefs.begin(configNamespace, false))
+        return false;
+    bool ok = prefs.putBytes(key, data, len) == len;
+    prefs.end();
+    return ok;
+}
+
+void halConsoleWrite(const uint8_t* data, size_t len) {
+    Serial.write(data, len);
+}
+
+void halLogf(const char* fmt, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    Serial.println(line);
+}
@@ -0,0 +1,127 @@
+#include "lmp91000_driver.h"
+#include <Arduino.h>
+#include <Wire.h>
+#include "../util/metrics.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+static const uint32_t i2cClockHz = 400000;   // fast mode, the LMP91000 maximum
+
+// Last requested configuration of a chip, and whether it is known to hold it.
+struct Chip {
+    uint8_t menbPin;
+    LmpConfig shadow;
+    bool configured;
+    bool shadowValid;
+    bool unlocked;   // TIACN and REFCN are write-protected while LOCK = 1
+};
+
+static Chip chips[LMP_MAX_CHIPS];
+static uint8_t numChips = 0;
+static Chip* selected = &chips[0];
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+static bool writeRegister(uint8_t reg, uint8_t value) {
+    Wire.beginTransmission(LMP_I2C_ADDRESS);
+    Wire.write(reg);
+    Wire.write(value);
+    metricsCount(COUNTER_LMP_WRITES, 1);
+    return Wire.endTransmission() == 0;
+}
+
+static bool unlock(Chip& chip) {
+    if (chip.unlocked)
+        return true;
+    chip.unlocked = writeRegister(LMP_REG_LOCK, 0x00);
+    return chip.unlocked;
+}
+
+static bool invalidate(Chip& chip) {
+    chip.shadowValid = false;
+    chip.unlocked = false;
+    return false;
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+void lmpDriverBegin(const uint8_t* menbPins, uint8_t count) {
+    numChips = count < LMP_MAX_CHIPS ? count : LMP_MAX_CHIPS;
+    for (uint8_t i = 0; i < numChips; i++) {
+        chips[i] = Chip();
+        chips[i].menbPin = menbPins[i];
+        pinMode(menbPins[i], OUTPUT);
+        digitalWrite(menbPins[i], i == 0 ? LOW : HIGH);   // MENB is active low
+    }
+    selected = &chips[0];
+    Wire.setClock(i2cClockHz);
+}
+
+void lmpDriverSelect(uint8_t chip) {
+    if (chip >= numChips || &chips[chip] == selected)
+        return;
+    digitalWrite(selected->menbPin, HIGH);
+    selected = &chips[chip];
+    digitalWrite(selected->menbPin, LOW);
+}
+
+bool lmpDriverApply(const LmpConfig& config) {
+    Chip& chip = *selected;
+    bool tiacn = !chip.shadowValid || config.tiacn != chip.shadow.tiacn;
+    bool refcn = !chip.shadowValid || config.refcn != chip.shadow.refcn;
+    bool modecn = !chip.shadowValid || config.modecn != chip.shadow.modecn;
+    chip.shadow = config;
+    chip.configured = true;
+
+    if ((tiacn || refcn) && !unlock(chip))
+        return invalidate(chip);
+    if (tiacn && !writeRegister(LMP_REG_TIACN, config.tiacn))
+        return invalidate(chip);
+    if (refcn && !writeRegister(LMP_REG_REFCN, config.refcn))
+        return invalidate(chip);
+    if (modecn && !writeRegister(LMP_REG_MODECN, config.modecn))
+        return invalidate(chip);
+
+    chip.shadowValid = true;
+    return true;
+}
+
+bool lmpDriverSetGain(uint8_t gain) {
+    const Chip& chip = *selected;
+    if (!chip.configured)
+        return false;
+    LmpConfig config = chip.shadow;
+    config.tiacn = lmpTiacn(gain, chip.shadow.tiacn & 0x03);
+    return lmpDriverApply(config);
+}
+
+bool lmpDriverSetMode(uint8_t mode) {
+    const Chip& chip = *selected;
+    if (!chip.configured)
+        return false;
+    LmpConfig config = chip.shadow;
+    config.modecn = lmpModecn((chip.shadow.modecn & 0x80) != 0, mode);
+    return lmpDriverApply(config);
+}
+
+bool lmpDriverSetBias(uint8_t biasIndex, int8_t sign) {
+    const Chip& chip = *selected;
+    if (!chip.configured)
+        return false;
+    bool negative = sign == 0 ? (chip.shadow.refcn & 0x10) == 0 : sign < 0;
+    LmpConfig config = chip.shadow;
+    config.refcn = lmpRefcnWithBias(chip.shadow.refcn, negative, biasIndex);
+    return lmpDriverApply(config);
+}
+
+bool lmpDriverIsApplied(const LmpConfig& config) {
+    const Chip& chip = *selected;
+    return chip.shadowValid && config.tiacn == chip.shadow.tiacn &&
+           config.refcn == chip.shadow.refcn && config.modecn == chip.shadow.modecn;
+}
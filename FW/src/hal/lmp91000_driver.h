@@ -0,0 +1,91 @@
+#ifndef LMP91000_DRIVER_H
+#define LMP91000_DRIVER_H
+
+#include <stdint.h>
+
+// Register-level LMP91000 access for the ESP32 HAL. The driver keeps a
+// shadow of TIACN, REFCN and MODECN and only writes registers whose value
+// differs from it, without the read-modify-write the LMP91000 library does
+// for every setter. A bias step with a sign change is then a single REFCN
+// write, and re-applying the configuration a sweep already uses costs no bus
+// traffic at all.
+//
+// Several chips can share the bus: all answer at LMP_I2C_ADDRESS, and only
+// the one whose MENB pin is low listens. Each chip has its own shadow; the
+// calls below act on the selected chip. A chip keeps its configuration, and
+// keeps biasing its cell, while it is deselected.
+
+// Register addresses (datasheet section 7.6).
+const uint8_t LMP_I2C_ADDRESS = 0x48;
+const uint8_t LMP_REG_LOCK    = 0x01;
+const uint8_t LMP_REG_TIACN   = 0x10;
+const uint8_t LMP_REG_REFCN   = 0x11;
+const uint8_t LMP_REG_MODECN  = 0x12;
+
+// MODECN operating modes.
+const uint8_t LMP_MODE_DEEP_SLEEP = 0x00;
+const uint8_t LMP_MODE_STANDBY    = 0x02;
+const uint8_t LMP_MODE_THREE_LEAD = 0x03;
+
+// Internal zero (REFCN[6:5]).
+const uint8_t LMP_INT_Z_20  = 0;
+const uint8_t LMP_INT_Z_50  = 1;
+const uint8_t LMP_INT_Z_67  = 2;
+
+struct LmpConfig {
+    uint8_t tiacn;
+    uint8_t refcn;
+    uint8_t modecn;
+};
+
+// TIACN: TIA gain index (0 = external resistor) and load resistor index.
+inline uint8_t lmpTiacn(uint8_t gain, uint8_t rload) {
+    return (uint8_t)(((gain & 0x07) << 2) | (rload & 0x03));
+}
+
+// REFCN: reference source, internal zero, bias sign and bias index.
+inline uint8_t lmpRefcn(bool externalRef, uint8_t intZ, bool negative, uint8_t biasIndex) {
+    return (uint8_t)((externalRef ? 0x80 : 0) | ((intZ & 0x03) << 5) | (negative ? 0 : 0x10) |
+                     (biasIndex & 0x0F));
+}
+
+// REFCN with the sign and bias index replaced.
+inline uint8_t lmpRefcnWithBias(uint8_t refcn, bool negative, uint8_t biasIndex) {
+    return (uint8_t)((refcn & 0xE0) | (negative ? 0 : 0x10) | (biasIndex & 0x0F));
+}
+
+inline uint8_t lmpModecn(bool fetShort, uint8_t mode) {
+    return (uint8_t)((fetShort ? 0x80 : 0) | (mode & 0x07));
+}
+
+const uint8_t LMP_MAX_CHIPS = 8;
+
+// Takes over the MENB pins of `count` chips, selects chip 0 and sets the I2C
+// bus to 400 kHz. The shadows start out unknown, so the first apply to each
+// chip writes every register.
+void lmpDriverBegin(const uint8_t* menbPins, uint8_t count);
+
+// Routes the following calls to `chip` (a MENB switch, no bus traffic).
+void lmpDriverSelect(uint8_t chip);
+
+// Brings the chip to `config`, writing only the registers that differ from
+// the shadow. Returns false if a write failed; the chip state is then
+// treated as unknown and the next call rewrites everything.
+bool lmpDriverApply(const LmpConfig& config);
+
+// TIACN-only update of the gain index, keeping the load resistor. Returns
+// false before the first apply.
+bool lmpDriverSetGain(uint8_t gain);
+
+// MODECN-only update of the operating mode, keeping the FET short. Returns
+// false before the first apply.
+bool lmpDriverSetMode(uint8_t mode);
+
+// REFCN-only update for bias steps; sign 0 keeps the current sign. Returns
+// false before the first apply.
+bool lmpDriverSetBias(uint8_t biasIndex, int8_t sign);
+
+// True if the chip is known to hold `config`.
+bool lmpDriverIsApplied(const LmpConfig& config);
+
+#endif // LMP91000_DRIVER_H
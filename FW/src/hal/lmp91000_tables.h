@@ -0,0 +1,16 @@
+#ifndef LMP91000_TABLES_H
+#define LMP91000_TABLES_H
+
+#include <stdint.h>
+
+// LMP91000 TIA gain (Ω) and bias (fraction of Vref) tables. On the device
+// they come from the LMP91000 library; host builds carry the same values.
+#ifdef ARDUINO
+#include "LMP91000.h"
+#else
+const double TIA_GAIN[] = {2750, 3500, 7000, 14000, 35000, 120000, 350000};
+const double TIA_BIAS[] = {0, 0.01, 0.02, 0.04, 0.06, 0.08, 0.1, 0.12, 0.14, 0.16, 0.18, 0.2, 0.22, 0.24};
+const uint8_t NUM_TIA_BIAS = 14;
+#endif
+
+#endif // LMP91000_TABLES_H
@@ -1,124 +1,823 @@
 #include <Arduino.h>
 #include "device/device.h"   // Contains initHardware, toggleLED, setLED, getFreeHeap, etc.
 #include "device/pstat.h"    // Contains pstatInit, runSWV, data logging and helper functions
-#include "network/comms.h"   // Contains sendCSVData
+#include "network/live_stream.h" // Contains streamInit (live WebSocket points)
+#include "network/publisher.h"   // Contains publisherInit, publishSweep
+#include "network/backend_registry.h" // Contains backendRegistryBegin, discovery
+#include "device/trace_log.h"   // Contains traceLogDrainText
+#include "device/sweep_jobs.h"  // Contains sweepJobSubmit, sweepJobNext
+#include "device/sweep_log.h"   // Contains sweepLogAppend, sweepLogNextUnsent
+#include "device/duty_cycle.h"  // Contains dutyCycleLoad, dutyCycleUpdate, dutyCycleSweepDone
+#include "util/metrics.h"       // Contains metricsWrite, phase timing
+#include "hal/hal.h"            // Contains halDeepSleep, halWokeFromSleep
+#include "util/spsc_queue.h"
 
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
 
-// Create a web server on port 80.
-WebServer server(80);
+// Web server on port 80. Requests are served from the AsyncTCP task, so they
+// are answered while a sweep or an export is in progress.
+AsyncWebServer server(80);
 
-// Global flag to indicate a sweep is requested.
-volatile bool sweepRequested = false;
+// Upload sweeps in the compact SWVB binary format instead of CSV.
+static const bool uploadBinary = true;
 
-// HTTP GET handler for "/sweep"
-void handleSweepRequest() {
-    sweepRequested = true;
-    server.send(200, "text/plain", "Sweep requested");
+// Backends are discovered at run time: services advertising
+// "_metallyze._tcp" over mDNS, and every station of the access point, which
+// is assumed to accept uploads on backendPort at backendPath. Backends found
+// neither way go in staticBackendURLs (NULL-terminated), e.g.
+// "http://10.0.0.5:8080/upload"; ones on the AP subnet only receive sweeps
+// while they hold a lease.
+static const uint16_t backendPort = 80;
+static const char* backendPath = "/upload";
+static const char* staticBackendURLs[] = {
+    NULL
+};
+
+// Station leases are cheap to scan; an mDNS query takes about 3 s on the
+// discovery task.
+static const uint32_t leaseScanMs = 1000;
+static const uint32_t mdnsQueryMs = 30000;
+
+// Per-backend request timeout, and how long a finished sweep may wait for
+// the previous publish to complete.
+static const uint32_t backendTimeoutMs = 2000;
+static const uint32_t publishWaitMs = 2500;
+
+// After a publish no backend accepted, wait this long before replaying
+// logged sweeps again.
+static const uint32_t replayRetryMs = 5000;
+
+// Publish only the on-device peak/concentration summary, with the full
+// curve every fullCurveEvery sweeps or when requested on "/curve".
+static const bool summaryUploads = true;
+static const uint16_t fullCurveEvery = 10;
+
+// Also broadcast each sweep as UDP datagrams (port 5005) on the AP subnet.
+static const bool udpBroadcast = false;
+
+// Run the default protocol whenever no job is queued.
+static const bool continuousSweeps = true;
+
+// Largest JSON sweep spec accepted on "/jobs".
+static const size_t maxJobBodyLen = 512;
+
+// What the acquisition task is doing, for "/status".
+enum SweepState : uint8_t { SWEEP_IDLE, SWEEP_WAITING_BUFFER, SWEEP_RUNNING };
+static const char* sweepStateNames[] = {"idle", "waiting_buffer", "running"};
+static volatile SweepState sweepState = SWEEP_IDLE;
+static volatile uint32_t sweepsCompleted = 0;
+static volatile float lastConcentration = 0;
+
+// Sweep buffers cycle between the acquisition task (core 1), which records
+// into free buffers, one per channel swept, and the comms task (core 0),
+// which exports filled ones and hands them back. With two buffers per
+// channel the next sweep runs while the previous one is being written and
+// published. Sample storage is only allocated for buffers that get used.
+static const uint8_t numSweepBuffers = 2 * HAL_MAX_CHANNELS;
+static SweepBuffer sweepBuffers[numSweepBuffers];
+static SpscQueue<SweepBuffer*, 32> freeBuffers;     // comms -> acquisition
+static SpscQueue<SweepBuffer*, 32> filledBuffers;   // acquisition -> comms
+static TaskHandle_t commsTaskHandle = NULL;
+
+// Set by "/duty" when it enables duty-cycled mode; the comms task restarts
+// into it.
+static volatile bool restartPending = false;
+
+// HTTP handlers run in the AsyncTCP task: they must not block, so they only
+// set flags or read state the other tasks publish.
+
+// Answers a submitted job with its ID, or 503 if its queue is full.
+static void sendJobSubmitted(AsyncWebServerRequest* request, uint32_t id) {
+    if (id == 0) {
+        request->send(503, "application/json", "{\"error\":\"job queue full\"}");
+        return;
+    }
+    char body[48];
+    snprintf(body, sizeof(body), "{\"id\":%lu}", (unsigned long)id);
+    request->send(202, "application/json", body);
 }
 
-void setup() {
-    // Initialize device hardware.
-    initHardware();
+// HTTP GET handler for "/sweep": queues one sweep of the default protocol.
+void handleSweepRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    sendJobSubmitted(request, sweepJobSubmit(SWEEP_JOB_DEFAULT));
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
 
-    // Optionally enable debug for device and pstat modules.
-    setDebugLevel(true);
-    setPstatDebug(true);
+// Collects the body of a "/jobs" POST into the request's scratch object,
+// which the server frees with the request.
+void handleJobBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    if (total > maxJobBodyLen)
+        return;
+    if (index == 0)
+        request->_tempObject = malloc(total + 1);
+    char* body = (char*)request->_tempObject;
+    if (body == NULL)
+        return;
+    memcpy(body + index, data, len);
+    if (index + len == total)
+        body[total] = '\0';
+}
 
-    // Initialize the HTTP server and register the sweep handler.
-    server.on("/sweep", HTTP_GET, handleSweepRequest);
-    server.begin();
+// HTTP POST handler for "/jobs": queues a sweep job given as JSON, e.g.
+//   {"gain":7,"startV":-200,"endV":200,"stepV":5,"pulseAmp":20,"freq":10,
+//    "repeat":3,"priority":1,"channels":3}
+// "channels" is a mask of the front ends to sweep together (bit n = channel
+// n, default 1). "coarseStepV" and "windowMv" make it adaptive: a coarse
+// pass over the whole range, then stepV over windowMv around the peak.
+// Missing fields take the default protocol's values.
+void handleJobSubmit(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    const char* body = (const char*)request->_tempObject;
+    StaticJsonDocument<384> doc;
+    if (body == NULL || deserializeJson(doc, body, strlen(body))) {
+        request->send(400, "application/json", "{\"error\":\"expected a JSON sweep spec\"}");
+        metricsEnd(PHASE_HTTP_SERVER, start);
+        return;
+    }
 
-    Serial.println("System initialized. Waiting for sweep request...");
+    SweepJobSpec spec = SWEEP_JOB_DEFAULT;
+    spec.gain = doc["gain"] | spec.gain;
+    spec.startV = doc["startV"] | spec.startV;
+    spec.endV = doc["endV"] | spec.endV;
+    spec.stepV = doc["stepV"] | spec.stepV;
+    spec.pulseAmp = doc["pulseAmp"] | spec.pulseAmp;
+    spec.freq = doc["freq"] | spec.freq;
+    spec.repeat = doc["repeat"] | spec.repeat;
+    spec.priority = doc["priority"] | spec.priority;
+    spec.coarseStepV = doc["coarseStepV"] | spec.coarseStepV;
+    spec.windowMv = doc["windowMv"] | spec.windowMv;
+    spec.channels = doc["channels"] | spec.channels;
+
+    const char* error = sweepJobValidate(spec);
+    if (error != NULL) {
+        char reply[128];
+        snprintf(reply, sizeof(reply), "{\"error\":\"%s\"}", error);
+        request->send(400, "application/json", reply);
+    } else {
+        sendJobSubmitted(request, sweepJobSubmit(spec));
+    }
+    metricsEnd(PHASE_HTTP_SERVER, start);
 }
 
-void loop() {
-    // Process any incoming HTTP requests.
-    server.handleClient();
-    static unsigned long lastSweepTime = 0U;
-    static const unsigned long sweepInterval = 1U;
+// HTTP GET handler for "/job?id=N": state and latest result of a job.
+void handleJobStatus(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    SweepJobStatus job;
+    if (!request->hasParam("id") || !sweepJobStatus(request->getParam("id")->value().toInt(), job)) {
+        request->send(404, "application/json", "{\"error\":\"unknown job\"}");
+        metricsEnd(PHASE_HTTP_SERVER, start);
+        return;
+    }
+    char body[256];
+    snprintf(body, sizeof(body),
+             "{\"id\":%lu,\"state\":\"%s\",\"completed\":%u,\"repeat\":%u,\"sweepId\":%lu,"
+             "\"peakV\":%.4f,\"peakUa\":%.4f,\"heightUa\":%.4f,\"concentration\":%.2f,\"flags\":%u}",
+             (unsigned long)job.id, sweepJobStateName(job.state), job.completed, job.spec.repeat,
+             (unsigned long)job.lastSweepId, job.last.peakMv / 1000.0f, job.last.peakUa,
+             job.last.heightUa, job.last.concentration, job.last.flags);
+    request->send(200, "application/json", body);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
+
+static const char* const dspSmoothingNames[] = {"none", "ma", "sg"};
+static const char* const dspBaselineNames[] = {"none", "linear", "quadratic"};
 
-    // Set sweepRequested every sweepInterval without blocking.
-    if (millis() - lastSweepTime >= sweepInterval) {
-        sweepRequested = true;
+// Index of a query parameter's value in names; keeps `current` if the
+// parameter is absent, -1 if its value is unknown.
+static int dspParamIndex(AsyncWebServerRequest* request, const char* param,
+                         const char* const* names, int count, int current) {
+    if (!request->hasParam(param))
+        return current;
+    const String& value = request->getParam(param)->value();
+    for (int i = 0; i < count; i++) {
+        if (value == names[i])
+            return i;
     }
+    return -1;
+}
 
-    // Only run the sweep if the flag is set.
-    if (sweepRequested) {
-        // Reset the flag.
-        sweepRequested = false;
+// HTTP GET handler for "/dsp": noise reduction of the following sweeps, e.g.
+// /dsp?median=5&smooth=sg&window=7&baseline=linear&edge=8. Parameters left
+// out keep their value. The change applies from the next sweep on and is
+// stored by the comms task; replies with the new configuration.
+void handleDspRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    DspConfig config = getDspConfig();
+    if (request->hasParam("median"))
+        config.medianWindow = request->getParam("median")->value().toInt();
+    if (request->hasParam("window"))
+        config.smoothWindow = request->getParam("window")->value().toInt();
+    if (request->hasParam("edge"))
+        config.edgePoints = request->getParam("edge")->value().toInt();
+    int smoothing = dspParamIndex(request, "smooth", dspSmoothingNames, 3, config.smoothing);
+    int baseline = dspParamIndex(request, "baseline", dspBaselineNames, 3, config.baseline);
 
-        // --- Step 1: Clear Data Memory ---
-        Serial.println("Clearing data memory...");
-        clearVoltammogramFile();
-        clearVoltammogramArrays();
-        Serial.println("Data memory cleared.");
+    const char* error = NULL;
+    if (smoothing < 0 || baseline < 0) {
+        error = "unknown smoothing or baseline";
+    } else {
+        config.smoothing = smoothing;
+        config.baseline = baseline;
+        error = dspConfigValidate(config);
+    }
+    if (error != NULL || !updateDspConfig(config)) {
+        char reply[128];
+        snprintf(reply, sizeof(reply), "{\"error\":\"%s\"}",
+                 error != NULL ? error : "too many updates pending; retry after the next sweep");
+        request->send(error != NULL ? 400 : 503, "application/json", reply);
+        metricsEnd(PHASE_HTTP_SERVER, start);
+        return;
+    }
+    char body[128];
+    snprintf(body, sizeof(body),
+             "{\"median\":%u,\"smooth\":\"%s\",\"window\":%u,\"baseline\":\"%s\",\"edge\":%u}",
+             config.medianWindow, dspSmoothingNames[config.smoothing], config.smoothWindow,
+             dspBaselineNames[config.baseline], config.edgePoints);
+    request->send(200, "application/json", body);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
 
-        // --- Step 2: Log Memory Usage ---
-        unsigned long freeHeap = getFreeHeap();
-        Serial.print("Free heap: ");
-        Serial.println(freeHeap);
+// HTTP GET handler for "/range": automatic gain ranging of the following
+// sweeps, e.g. /range?enabled=1&headroom=64&span=128&settle=2000&min=1&max=7.
+// Parameters left out keep their value. Applied and stored like "/dsp";
+// replies with the new configuration.
+void handleRangeRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    AutoRangeConfig config = getAutoRange();
+    if (request->hasParam("enabled"))
+        config.enabled = request->getParam("enabled")->value().toInt() != 0;
+    if (request->hasParam("headroom"))
+        config.headroomCodes = request->getParam("headroom")->value().toInt();
+    if (request->hasParam("span"))
+        config.minSpanCodes = request->getParam("span")->value().toInt();
+    if (request->hasParam("settle"))
+        config.settleUs = request->getParam("settle")->value().toInt();
+    if (request->hasParam("min"))
+        config.minGain = request->getParam("min")->value().toInt();
+    if (request->hasParam("max"))
+        config.maxGain = request->getParam("max")->value().toInt();
 
-        // --- Step 3: Run SWV Sweep ---
-        Serial.println("Starting SWV sweep...");
+    if (!updateAutoRange(config)) {
+        request->send(400, "application/json",
+                      "{\"error\":\"gains must be 1..7 with min <= max, headroom below 1023, span above 0"
+                      " (or too many updates pending)\"}");
+        metricsEnd(PHASE_HTTP_SERVER, start);
+        return;
+    }
+    char body[160];
+    snprintf(body, sizeof(body),
+             "{\"enabled\":%s,\"headroom\":%u,\"span\":%u,\"settle\":%lu,\"min\":%u,\"max\":%u}",
+             config.enabled ? "true" : "false", config.headroomCodes, config.minSpanCodes,
+             (unsigned long)config.settleUs, config.minGain, config.maxGain);
+    request->send(200, "application/json", body);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
 
-        // Print current pstat settings.
-        Serial.print("Pstat Gain: ");
-        Serial.println(getPstatGain());
-        Serial.print("Pstat Bias: ");
-        Serial.println(getPstatBias());
-        Serial.print("ADC Averages: ");
-        Serial.println(getAdcAverages());
-        Serial.println("SWV Settings: Gain=7, StartV=-200 mV, EndV=200 mV, PulseAmp=20 mV, StepV=5 mV, Freq=10 Hz, SetToZero=true");
+// HTTP GET handler for "/calibration": the line that turns peak heights into
+// concentrations, e.g. /calibration?slope=0.03&intercept=1.0&baseline=1.
+// Parameters left out keep their value. Applied and stored like "/dsp";
+// replies with the new calibration.
+void handleCalibrationRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    PeakCalibration calibration = getPeakCalibration();
+    if (request->hasParam("slope"))
+        calibration.slope = request->getParam("slope")->value().toFloat();
+    if (request->hasParam("intercept"))
+        calibration.intercept = request->getParam("intercept")->value().toFloat();
+    if (request->hasParam("baseline"))
+        calibration.baselineCorrected = request->getParam("baseline")->value().toInt() != 0;
 
-        runSWV(7, -200, 200, 20, 5, 10.0, true);
-        Serial.println("SWV sweep complete.");
+    bool valid = isfinite(calibration.slope) && calibration.slope != 0.0f &&
+                 isfinite(calibration.intercept);
+    if (!valid || !updatePeakCalibration(calibration)) {
+        request->send(valid ? 503 : 400, "application/json",
+                      valid ? "{\"error\":\"too many updates pending; retry after the next sweep\"}"
+                            : "{\"error\":\"slope must be non-zero and both values finite\"}");
+        metricsEnd(PHASE_HTTP_SERVER, start);
+        return;
+    }
+    char body[128];
+    snprintf(body, sizeof(body), "{\"slope\":%.6f,\"intercept\":%.6f,\"baseline\":%s}",
+             calibration.slope, calibration.intercept,
+             calibration.baselineCorrected ? "true" : "false");
+    request->send(200, "application/json", body);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
 
-        // --- Step 4: Write and Send Data Over Serial ---
-        Serial.println("Writing logged data to file...");
-        writeVoltammogramToFile();
-        Serial.println("Data written to /data.csv.");
+// HTTP GET handler for "/adc": ADC calibration of one front end, e.g.
+// /adc?channel=1&a=-146.63&b=7.64. Parameters left out keep their value.
+// Applied and stored like "/dsp"; replies with the channel's new calibration.
+void handleAdcCalibrationRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    int channel = 0;
+    if (request->hasParam("channel"))
+        channel = request->getParam("channel")->value().toInt();
+    bool valid = channel >= 0 && channel < pstatChannelCount();
+    AdcCalibration calibration = getChannelCalibration(valid ? channel : 0);
+    if (request->hasParam("a"))
+        calibration.aCoeff = request->getParam("a")->value().toFloat();
+    if (request->hasParam("b"))
+        calibration.bCoeff = request->getParam("b")->value().toFloat();
 
-        Serial.println("Sending logged data over Serial...");
-        readFileAndSendOverSerial();
-        Serial.println("\nData sent over Serial.");
+    valid = valid && isfinite(calibration.aCoeff) && isfinite(calibration.bCoeff) &&
+            calibration.bCoeff != 0.0f;
+    if (!valid || !updateChannelCalibration(channel, calibration)) {
+        request->send(valid ? 503 : 400, "application/json",
+                      valid ? "{\"error\":\"too many updates pending; retry after the next sweep\"}"
+                            : "{\"error\":\"unknown channel, or b is zero or a value is not finite\"}");
+        metricsEnd(PHASE_HTTP_SERVER, start);
+        return;
+    }
+    char body[96];
+    snprintf(body, sizeof(body), "{\"channel\":%d,\"a\":%.4f,\"b\":%.4f}", channel,
+             calibration.aCoeff, calibration.bCoeff);
+    request->send(200, "application/json", body);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
+
+// HTTP GET handler for "/duty": duty-cycled measurement (see duty_cycle.h),
+// e.g. /duty?enabled=1&period=300&upload=6&window=30&budget=200. Parameters
+// left out keep their value. The configuration is stored for the next boot
+// by the comms task (or after the upload window); enabling it restarts the
+// device into it. Replies with the configuration
+// and the counters of the current duty cycle.
+void handleDutyRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    DutyCycleConfig config = dutyCycleRequested();
+    bool wasEnabled = config.enabled;
+    if (request->hasParam("enabled"))
+        config.enabled = request->getParam("enabled")->value().toInt() != 0;
+    if (request->hasParam("period"))
+        config.periodS = request->getParam("period")->value().toInt();
+    if (request->hasParam("upload"))
+        config.uploadEvery = request->getParam("upload")->value().toInt();
+    if (request->hasParam("window"))
+        config.uploadWindowS = request->getParam("window")->value().toInt();
+    if (request->hasParam("budget"))
+        config.wakeBudgetMs = request->getParam("budget")->value().toInt();
+
+    const char* error = dutyCycleValidate(config);
+    if (error != NULL || !dutyCycleUpdate(config)) {
+        char reply[128];
+        snprintf(reply, sizeof(reply), "{\"error\":\"%s\"}",
+                 error != NULL ? error : "too many updates pending; retry shortly");
+        request->send(error != NULL ? 400 : 503, "application/json", reply);
+        metricsEnd(PHASE_HTTP_SERVER, start);
+        return;
+    }
+    const DutyCycleState& state = dutyCycleState();
+    char body[256];
+    snprintf(body, sizeof(body),
+             "{\"enabled\":%s,\"period\":%lu,\"upload\":%u,\"window\":%u,\"budget\":%u,"
+             "\"wakes\":%lu,\"wakeToFirstSampleUs\":%lu,\"overBudget\":%lu,\"failedUploads\":%lu}",
+             config.enabled ? "true" : "false", (unsigned long)config.periodS, config.uploadEvery,
+             config.uploadWindowS, config.wakeBudgetMs, (unsigned long)state.wakes,
+             (unsigned long)state.lastWakeToSampleUs, (unsigned long)state.overBudget,
+             (unsigned long)state.failedUploads);
+    request->send(200, "application/json", body);
+    if (config.enabled && !wasEnabled)
+        restartPending = true;
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
+
+// HTTP GET handler for "/curve": publish the next sweep in full.
+void handleCurveRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    publisherRequestFullCurve();
+    request->send(200, "text/plain", "Full curve requested");
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
+
+// HTTP GET handler for "/status": acquisition state as JSON.
+void handleStatusRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    char body[224];
+    snprintf(body, sizeof(body),
+             "{\"state\":\"%s\",\"pendingJobs\":%u,\"sweeps\":%lu,\"concentration\":%.1f,"
+             "\"publishing\":%s,\"uploadedThrough\":%lu,\"freeHeap\":%lu}",
+             sweepStateNames[sweepState], sweepJobsPending(), (unsigned long)sweepsCompleted, lastConcentration,
+             publisherIdle() ? "false" : "true", (unsigned long)sweepLogWatermark(), getFreeHeap());
+    request->send(200, "application/json", body);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
+
+// HTTP GET handler for "/backends": the publisher's subscribers with their
+// source and circuit-breaker state, as a JSON array.
+void handleBackendsRequest(AsyncWebServerRequest* request) {
+    static const char* sourceNames[] = {"static", "mdns", "dhcp"};
+    static const char* breakerNames[] = {"closed", "open", "half_open"};
+    uint32_t start = metricsStart();
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    response->print("[");
+    PublisherStatus status;
+    for (uint8_t i = 0; getPublisherStatus(i, status); i++) {
+        response->printf("%s{\"url\":\"%s\",\"source\":\"%s\",\"breaker\":\"%s\",\"lastStatus\":%d,"
+                         "\"lastMs\":%lu,\"successes\":%lu,\"failures\":%lu,\"connects\":%lu}",
+                         i > 0 ? "," : "", status.url, sourceNames[status.source],
+                         breakerNames[status.breaker], status.lastStatus,
+                         (unsigned long)status.lastDurationMs, (unsigned long)status.successes,
+                         (unsigned long)status.failures, (unsigned long)status.connects);
+    }
+    response->print("]");
+    request->send(response);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
+
+static void sendMetricsText(const char* text, size_t len, void* ctx) {
+    static_cast<AsyncResponseStream*>(ctx)->write((const uint8_t*)text, len);
+}
+
+// HTTP GET handler for "/metrics": phase timings, jitter and memory in the
+// Prometheus text format.
+void handleMetricsRequest(AsyncWebServerRequest* request) {
+    uint32_t start = metricsStart();
+    metricsSetGauge(GAUGE_FREE_HEAP, getFreeHeap());
+    metricsSetGauge(GAUGE_MIN_FREE_HEAP, getMinFreeHeap());
+    metricsSetGauge(GAUGE_LARGEST_FREE_BLOCK, getLargestFreeBlock());
+    metricsSetGauge(GAUGE_TRACE_DROPPED, getTraceLogDropped());
+    metricsSetGauge(GAUGE_STREAM_DROPPED, getStreamDroppedPoints());
+    metricsSetGauge(GAUGE_LIVE_BACKENDS, backendRegistryLiveCount());
+
+    AsyncResponseStream* response = request->beginResponseStream("text/plain; version=0.0.4");
+    metricsWrite(sendMetricsText, response);
+    request->send(response);
+    metricsEnd(PHASE_HTTP_SERVER, start);
+}
+
+// One sweep of a job spec on the channels it selects, channel n recorded
+// into buffers[n]. The spec's gain applies to every channel. Channel 0 on
+// its own (every adaptive spec) takes the single-channel path, which falls
+// back to runSWV() for plain sweeps.
+static bool runSweepSpec(const SweepJobSpec& spec, SweepBuffer* const buffers[]) {
+    if (spec.channels == 0x01)
+        return runAdaptiveSWV(*buffers[0], spec.gain, spec.startV, spec.endV, spec.pulseAmp, spec.stepV,
+                              spec.coarseStepV, spec.windowMv, spec.freq, true);
+    for (uint8_t c = 0; c < HAL_MAX_CHANNELS; c++) {
+        if (spec.channels & (1u << c))
+            updateChannelGain(c, spec.gain);
+    }
+    return runSWVChannels(buffers, spec.channels, spec.startV, spec.endV, spec.pulseAmp, spec.stepV,
+                          spec.freq, true);
+}
+
+static uint8_t lowestChannel(uint8_t mask) {
+    uint8_t c = 0;
+    while (c < HAL_MAX_CHANNELS - 1 && !(mask & (1u << c)))
+        c++;
+    return c;
+}
+
+// Runs sweep jobs back to back on core 1.
+static void acquisitionTask(void* arg) {
+    // Held per channel until a sweep fills them.
+    SweepBuffer* buffers[HAL_MAX_CHANNELS] = {NULL};
+
+    for (;;) {
+        SweepJob job;
+        if (!sweepJobNext(job, continuousSweeps ? 0 : pdMS_TO_TICKS(10))) {
+            if (!continuousSweeps)
+                continue;
+            job.id = 0;   // idle sweep of the default protocol, not tracked
+            job.spec = SWEEP_JOB_DEFAULT;
+        }
+
+        bool ok = true;
+        const SweepJobSpec& spec = job.spec;
+        for (uint16_t n = 0; n < spec.repeat; n++) {
+            // Wait for the comms task to return a buffer for every channel.
+            // Polled rather than notified: this task's notification is
+            // reserved for the sample timer.
+            for (uint8_t c = 0; c < HAL_MAX_CHANNELS; c++) {
+                while ((spec.channels & (1u << c)) && buffers[c] == NULL && !freeBuffers.pop(buffers[c])) {
+                    sweepState = SWEEP_WAITING_BUFFER;
+                    vTaskDelay(1);
+                }
+            }
+            sweepState = SWEEP_RUNNING;
+
+            // --- Step 1: Run SWV Sweep ---
+            Serial.printf("Starting SWV sweep (job %lu, %u/%u, channels 0x%02x)...\n", (unsigned long)job.id,
+                          n + 1, spec.repeat, spec.channels);
+            Serial.printf("SWV Settings: Gain=%u, StartV=%d mV, EndV=%d mV, PulseAmp=%d mV, StepV=%d mV, "
+                          "Freq=%.1f Hz, ADC Averages=%d\n", spec.gain, spec.startV, spec.endV,
+                          spec.pulseAmp, spec.stepV, spec.freq, getAdcAverages());
+            if (spec.coarseStepV != 0)
+                Serial.printf("Adaptive: CoarseStepV=%d mV, WindowMv=%d mV\n", spec.coarseStepV, spec.windowMv);
+
+            if (!runSweepSpec(spec, buffers)) {
+                ok = false;
+                break;
+            }
+            Serial.println("SWV sweep complete.");
+            sweepJobSweepDone(job.id, *buffers[lowestChannel(spec.channels)]);
 
-        // --- Step 5: Optionally, Send Data Over HTTP ---
-        const char* backendURLs[] = {
-            // "http://metallyze-server.local:80/upload",
-            "http://192.168.4.2:80/upload",
-            "http://192.168.4.3:80/upload",
-            "http://192.168.4.4:80/upload",
-            "http://192.168.4.5:80/upload",
-            "http://192.168.4.6:80/upload",
-            "http://192.168.4.7:80/upload",
-            // "http://192.168.4.8:80/upload",
-            // "http://192.168.4.9:80/upload",
-            // "http://192.168.4.10:80/upload",
-            // "http://192.168.4.11:80/upload",
-            // "http://192.168.4.12:80/upload",
-            // "http://192.168.4.13:80/upload",
-            // "http://192.168.4.14:80/upload"
-        };
-        const int numBackends = sizeof(backendURLs) / sizeof(backendURLs[0]);
-
-        for (int i = 0; i < numBackends; i++) {
-            Serial.println("Sending CSV data to backend...");
-            if (sendCSVData(backendURLs[i])) {
-                Serial.println("CSV data sent successfully.");
-            } else {
-                Serial.println("Failed to send CSV data.");
+            // --- Step 2: Hand the sweeps over to the comms task ---
+            for (uint8_t c = 0; c < HAL_MAX_CHANNELS; c++) {
+                if (spec.channels & (1u << c)) {
+                    filledBuffers.push(buffers[c]);
+                    buffers[c] = NULL;
+                }
             }
+            xTaskNotifyGive(commsTaskHandle);
+        }
+        sweepJobFinish(job.id, ok);
+        sweepState = SWEEP_IDLE;
+        if (getDebugLevel()) {
+            Serial.printf("Acquisition stack: %u bytes never used.\n",
+                          (unsigned)uxTaskGetStackHighWaterMark(NULL));
         }
+    }
+}
+
+// Store-and-forward: sweeps are uploaded in ID order, oldest unsent first.
+// The sweep just recorded (`live`, may be NULL) goes out from RAM in the
+// publisher's format; older ones are replayed from the log as SWVB. The
+// watermark only advances when a backend accepted the sweep.
+static void forwardSweeps(const SweepBuffer* live) {
+    static bool retryWait = false;
+    static uint32_t retryAtMs = 0;
 
-        // --- Step 6: Log Memory Usage ---
-        freeHeap = getFreeHeap();
+    if (live != NULL) {
+        uint32_t waitStart = millis();
+        while (!publisherIdle() && millis() - waitStart < publishWaitMs)
+            vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    uint32_t sweepId;
+    bool delivered;
+    if (publisherTakeResult(sweepId, delivered)) {
+        retryWait = !delivered;
+        if (delivered)
+            sweepLogMarkUploaded(sweepId);
+        else
+            retryAtMs = millis() + replayRetryMs;
+    }
+    if (!publisherIdle()) {
+        if (live != NULL)
+            Serial.println("Previous publish still in flight; sweep left in the log.");
+        return;
+    }
+
+    // Without a usable log there is nothing to replay: publish live only.
+    if (!sweepLogReady()) {
+        if (live != NULL)
+            publishSweep(*live, 0);
+        return;
+    }
+    if (retryWait && (int32_t)(millis() - retryAtMs) < 0)
+        return;
+
+    SweepLogEntry next;
+    if (!sweepLogNextUnsent(next)) {
+        // Nothing unsent in the log; a live sweep missing from it still goes out.
+        if (live != NULL && live->sweepId > sweepLogLastId())
+            publishSweep(*live, 0);
+        return;
+    }
+    if (live != NULL && next.sweepId == live->sweepId) {
+        Serial.println("Publishing sweep data to backends...");
+        publishSweep(*live, 0);
+        return;
+    }
+
+    size_t len;
+    uint8_t* swvb = sweepLogRead(next, len);
+    if (swvb == NULL) {
+        // Corrupt record: skip it rather than retrying it forever.
+        Serial.printf("Logged sweep %lu unreadable; skipped.\n", (unsigned long)next.sweepId);
+        sweepLogMarkUploaded(next.sweepId);
+        return;
+    }
+    Serial.printf("Replaying logged sweep %lu (%u bytes)...\n", (unsigned long)next.sweepId,
+                  (unsigned)len);
+    publishStoredSweep(next.sweepId, swvb, len);
+}
+
+// Logs and exports finished sweeps on core 0, and replays unsent ones. Also
+// persists the settings changed over HTTP, whose handlers must not block.
+static void commsTask(void* arg) {
+    for (;;) {
+        SweepBuffer* buffer;
+        pstatSaveSettings();
+        if (!dutyCycleSave())
+            Serial.println("Duty-cycle configuration not stored.");
+        if (restartPending) {
+            Serial.println("Restarting into duty-cycled mode...");
+            vTaskDelay(pdMS_TO_TICKS(500));   // let the "/duty" reply go out
+            dutyCycleSave();   // queued after the save above
+            ESP.restart();
+        }
+        if (!filledBuffers.pop(buffer)) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            forwardSweeps(NULL);
+            continue;
+        }
+
+        const PeakSummary& summary = buffer->summary;
+        sweepsCompleted++;
+        lastConcentration = summary.concentration;
+        Serial.printf("Channel %u peak: %.4f uA at %.1f mV (height %.4f uA), concentration %.1f, flags 0x%02x\n",
+                      buffer->channel, summary.peakUa, summary.peakMv, summary.heightUa,
+                      summary.concentration, summary.flags);
+
+        // --- Step 3: Append to the sweep log and send over Serial ---
+        uint32_t start = metricsStart();
+        if (sweepLogAppend(*buffer))
+            Serial.printf("Sweep %lu appended to the log.\n", (unsigned long)buffer->sweepId);
+        else
+            Serial.println("Sweep log append failed.");
+        metricsEnd(PHASE_FILE_WRITE, start);
+
+        Serial.println("Sending sweep data over Serial...");
+        start = metricsStart();
+        writeVoltammogramToConsole(*buffer);
+        metricsEnd(PHASE_SERIAL_DUMP, start);
+        Serial.println("\nData sent over Serial.");
+
+        // --- Step 4: Publish to all backends concurrently ---
+        // Uploading runs on the publisher task; this only snapshots the sweep
+        // (or an older unsent one from the log).
+        forwardSweeps(buffer);
+
+        // --- Step 5: Return the buffer and log memory usage ---
+        freeBuffers.push(buffer);
+
+        unsigned long freeHeap = getFreeHeap();
         Serial.print("Free heap: ");
         Serial.println(freeHeap);
 
-        Serial.println("Sweep cycle complete. Waiting for next sweep request...");
+        Serial.println("Sweep cycle complete.");
+    }
+}
+
+// Prints the pstat sample trace at the lowest priority, off the sampling path.
+static void traceTask(void* arg) {
+    for (;;) {
+        if (traceLogDrainText(32) == 0)
+            vTaskDelay(pdMS_TO_TICKS(20));
+    }
+}
 
-        // Update time of last sweep.
-        lastSweepTime = millis();
+// Registers the HTTP handlers and starts the server.
+static void startServer() {
+    server.on("/sweep", HTTP_GET, handleSweepRequest);
+    server.on("/jobs", HTTP_POST, handleJobSubmit, NULL, handleJobBody);
+    server.on("/job", HTTP_GET, handleJobStatus);
+    server.on("/curve", HTTP_GET, handleCurveRequest);
+    server.on("/dsp", HTTP_GET, handleDspRequest);
+    server.on("/range", HTTP_GET, handleRangeRequest);
+    server.on("/calibration", HTTP_GET, handleCalibrationRequest);
+    server.on("/adc", HTTP_GET, handleAdcCalibrationRequest);
+    server.on("/status", HTTP_GET, handleStatusRequest);
+    server.on("/backends", HTTP_GET, handleBackendsRequest);
+    server.on("/duty", HTTP_GET, handleDutyRequest);
+    server.on("/metrics", HTTP_GET, handleMetricsRequest);
+    server.begin();
+}
+
+// Starts backend discovery and the publisher.
+static void startPublisher() {
+    backendRegistryBegin(backendPort, backendPath);
+    for (int i = 0; staticBackendURLs[i] != NULL; i++) {
+        backendRegistryAddStatic(staticBackendURLs[i]);
     }
+    backendRegistryStartDiscovery(leaseScanMs, mdnsQueryMs);
+    publisherInit(uploadBinary ? VOLTAMMOGRAM_BINARY : VOLTAMMOGRAM_CSV, backendTimeoutMs);
+    publisherSetSummaryMode(summaryUploads, fullCurveEvery);
+    publisherSetUdpBroadcast(udpBroadcast, 5005);
+}
+
+// Upload window of a duty cycle: the access point comes up, the unsent part
+// of the log goes to the backends, and the radio goes off again as soon as
+// it is delivered or the window is over.
+static void runUploadWindow(const DutyCycleConfig& duty) {
+    uint32_t windowStart = millis();
+    uint32_t windowMs = (uint32_t)duty.uploadWindowS * 1000;
+    startWiFiAP();
+    sweepJobsInit();
+    startServer();
+    startPublisher();
+
+    // Backends are stations of the access point; give them time to join
+    // and be discovered.
+    while (backendRegistryLiveCount() == 0 && millis() - windowStart < windowMs)
+        vTaskDelay(pdMS_TO_TICKS(50));
+
+    bool delivered = false;
+    SweepLogEntry next;
+    while (millis() - windowStart < windowMs) {
+        forwardSweeps(NULL);
+        if (publisherIdle() && !sweepLogNextUnsent(next)) {
+            delivered = true;
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    Serial.printf("Upload window %s after %lu ms.\n", delivered ? "delivered the log" : "timed out",
+                  (unsigned long)(millis() - windowStart));
+    stopWiFi();
+    dutyCycleUploadDone(delivered);
+}
+
+// Duty-cycled boot: the sweep runs straight after the wake, before the log
+// is opened or WiFi is considered; then the sweep is logged, uploaded if a
+// window is due, and the device sleeps until the next period. Sweep IDs
+// continue in RTC memory across deep sleep; after a reset they are seeded
+// from the log first. Does not return.
+static void runDutyCycle(const DutyCycleConfig& duty) {
+    initHardwareForMeasurement();
+    pstatInit(duty.spec.gain);
+    bool woke = halWokeFromSleep();
+    bool logReady = !woke && sweepLogBegin();
+    if (logReady)
+        setNextSweepId(sweepLogLastId() + 1);
+
+    const SweepJobSpec& spec = duty.spec;
+    SweepBuffer* buffers[HAL_MAX_CHANNELS] = {NULL};
+    for (uint8_t c = 0; c < HAL_MAX_CHANNELS; c++) {
+        if (spec.channels & (1u << c))
+            buffers[c] = &sweepBuffers[c];
+    }
+    bool swept = runSweepSpec(spec, buffers);
+    uint32_t wakeToSampleUs = (uint32_t)pstatFirstSampleUs();
+    bool inBudget = dutyCycleRecordWake(duty, wakeToSampleUs);
+    metricsSetGauge(GAUGE_WAKE_TO_FIRST_SAMPLE_US, wakeToSampleUs);
+
+    if (woke)
+        logReady = sweepLogBegin();
+    const DutyCycleState& state = dutyCycleState();
+    Serial.printf("Wake %lu: first sample %lu us after boot%s\n", (unsigned long)state.wakes,
+                  (unsigned long)wakeToSampleUs, inBudget ? "" : " (over budget)");
+    for (uint8_t c = 0; c < HAL_MAX_CHANNELS; c++) {
+        if (buffers[c] == NULL)
+            continue;
+        const SweepBuffer& sweep = *buffers[c];
+        bool logged = swept && logReady && sweepLogAppend(sweep);
+        Serial.printf("Channel %u: sweep %lu %s, concentration %.1f (flags 0x%02x)\n", c,
+                      (unsigned long)sweep.sweepId, logged ? "logged" : (swept ? "not logged" : "failed"),
+                      sweep.summary.concentration, sweep.summary.flags);
+    }
+
+    if (dutyCycleSweepDone(duty)) {
+        runUploadWindow(duty);
+        // No sweep follows before the sleep; keep what the window changed.
+        pstatApplySettings();
+        pstatSaveSettings();
+        dutyCycleSave();
+    }
+
+    // A window may have changed the configuration.
+    DutyCycleConfig next = dutyCycleLoad();
+    if (!next.enabled) {
+        Serial.println("Duty-cycled mode disabled; restarting.");
+        ESP.restart();
+    }
+    halDeepSleep(dutyCycleSleepUs(next, halTimeUs()));
+}
+
+void setup() {
+    DutyCycleConfig duty = dutyCycleLoad();
+    if (duty.enabled)
+        runDutyCycle(duty);
+
+    // Initialize device hardware.
+    initHardware();
+
+    // Optionally enable debug for device and pstat modules.
+    setDebugLevel(true);
+    setPstatDebug(true);
+    pstatInit(SWEEP_JOB_DEFAULT.gain);
+
+    // Sweep IDs continue from the log, so they stay unique across reboots.
+    if (!sweepLogBegin())
+        Serial.println("Sweep log unavailable; sweeps are published live only.");
+    setNextSweepId(sweepLogLastId() + 1);
+
+    // Sweep jobs are accepted as soon as the server is up.
+    sweepJobsInit();
+    startServer();
+
+    // Stream sweep points live to WebSocket clients on port 81.
+    streamInit(81);
+
+    startPublisher();
+
+    // Hand the sweep buffers to the pipeline and start it. Sample storage
+    // is allocated on first use, sized to the sweep.
+    for (uint8_t i = 0; i < numSweepBuffers; i++) {
+        freeBuffers.push(&sweepBuffers[i]);
+    }
+    xTaskCreatePinnedToCore(commsTask, "comms", 8192, NULL, 1, &commsTaskHandle, 0);
+    xTaskCreatePinnedToCore(traceTask, "trace", 3072, NULL, 0, NULL, 0);
+    // The sweep and the Serial.printf() formatting of its settings share this
+    // stack; its unused depth is logged after every job in debug.
+    xTaskCreatePinnedToCore(acquisitionTask, "acquisition", 8192, NULL, 2, NULL, 1);
+
+    Serial.println("System initialized. Waiting for sweep request...");
+}
+
+void loop() {
+    // All work runs in acquisitionTask and commsTask.
+    vTaskDelete(NULL);
 }
@@ -0,0 +1,245 @@
+#include "../hal/hal.h"
+#include "../hal/lmp91000_tables.h"
+#include "../device/voltammogram.h"
+#include "sim_cell.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <chrono>
+
+// HAL backend for host builds: a simulated LMP91000, DAC and ADC in front of
+// the cell model in sim_cell.cpp, on a virtual clock.
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+// Board constants the simulated front end follows; the calibration matches
+// pstat's defaults so converted currents come back as modelled.
+static const float opVolt = 3300.0f;       // DAC full scale (mV)
+static const float a_coeff = -146.63f;
+static const float b_coeff = 7.64f;
+static const uint32_t adcSampleRate = 200000;   // burst rate, as on the device
+static const uint32_t oneShotReadUs = 12;       // one-shot read, as on the device
+
+static int64_t nowUs = 0;
+static uint32_t pacerPeriodUs = 0;
+static int64_t nextTickUs = 0;
+
+// One simulated LMP91000 per channel, all on the shared DAC and all in
+// front of the same cell model (noise is drawn per read).
+struct SimChannel {
+    uint8_t biasIndex = 0;
+    bool biasNegative = false;
+    uint8_t gainIndex = 7;
+};
+
+static uint8_t dacCode = 0;
+static SimChannel channels[HAL_MAX_CHANNELS];
+static uint8_t numChannels = 1;
+static SimChannel* selected = &channels[0];
+static uint16_t adcWindow = 1;
+static bool adcBurst = true;
+
+static char storageRoot[256] = ".";
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+// Cell potential (mV) the LMP91000 currently applies.
+static float cellPotentialMv() {
+    float vref = dacCode * opVolt / 255.0f;
+    float e = vref * (float)TIA_BIAS[selected->biasIndex];
+    return selected->biasNegative ? -e : e;
+}
+
+// ADC code the TIA output produces for a cell current (µA).
+static uint16_t cellAdcCode(float currentUa) {
+    uint16_t vref = (uint16_t)(dacCode * opVolt / 255.0f);
+    return currentToAdc(currentUa, vref, selected->gainIndex, a_coeff, b_coeff);
+}
+
+//────────────────────────────────────────────────────────────
+// Timing
+//────────────────────────────────────────────────────────────
+
+int64_t halTimeUs() {
+    return nowUs;
+}
+
+void halDelayMs(uint32_t ms) {
+    nowUs += (int64_t)ms * 1000;
+}
+
+void halPacerStart(uint32_t periodUs) {
+    pacerPeriodUs = periodUs;
+    nextTickUs = nowUs + periodUs;
+}
+
+void halPacerStop() {
+    pacerPeriodUs = 0;
+}
+
+uint32_t halPacerWait() {
+    if (pacerPeriodUs == 0)
+        return 0;
+    // Ticks that already passed are reported at once, like the pending
+    // notifications on the device.
+    if (nowUs >= nextTickUs) {
+        uint32_t ticks = 1 + (uint32_t)((nowUs - nextTickUs) / pacerPeriodUs);
+        nextTickUs += (int64_t)ticks * pacerPeriodUs;
+        return ticks;
+    }
+    nowUs = nextTickUs;
+    nextTickUs += pacerPeriodUs;
+    return 1;
+}
+
+// Host CPU time, not the virtual clock: phase metrics measure how long the
+// code itself takes. Reported at 1000 cycles/µs (ns resolution).
+uint32_t halCycleCount() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t halCyclesPerUs() {
+    return 1000;
+}
+
+int64_t simElapsedUs() {
+    return nowUs;
+}
+
+//────────────────────────────────────────────────────────────
+// Analog front end
+//────────────────────────────────────────────────────────────
+
+void simSetChannelCount(uint8_t count) {
+    numChannels = count < 1 ? 1 : count > HAL_MAX_CHANNELS ? HAL_MAX_CHANNELS : count;
+}
+
+uint8_t halChannelCount() {
+    return numChannels;
+}
+
+void halSelectChannel(uint8_t channel) {
+    if (channel < numChannels)
+        selected = &channels[channel];
+}
+
+void halDacWrite(uint8_t code) {
+    dacCode = code;
+}
+
+// Like the device, bursts only capture a single channel.
+bool halAdcBegin(uint16_t windowSamples, uint8_t channelMask) {
+    adcWindow = windowSamples == 0 ? 1 : windowSamples;
+    adcBurst = (channelMask & (channelMask - 1)) == 0;
+    return adcBurst;
+}
+
+void halAdcEnd() {
+}
+
+uint16_t halAdcRead() {
+    nowUs += halAdcWindowUs();
+    float current = simCellCurrent(cellPotentialMv()) + simCellNoise(adcWindow);
+    return cellAdcCode(current);
+}
+
+uint32_t halAdcWindowUs() {
+    if (!adcBurst)
+        return adcWindow * oneShotReadUs;
+    return (uint32_t)adcWindow * 1000000UL / adcSampleRate;
+}
+
+void halLmpInit(uint8_t gain) {
+    selected->gainIndex = gain;
+    selected->biasIndex = 0;
+    selected->biasNegative = false;
+}
+
+void halLmpSetGain(uint8_t gain) {
+    selected->gainIndex = gain;
+}
+
+void halLmpSetBias(uint8_t index, int8_t sign) {
+    selected->biasIndex = index < NUM_TIA_BIAS ? index : NUM_TIA_BIAS - 1;
+    if (sign != 0)
+        selected->biasNegative = sign < 0;
+}
+
+void halLedWrite(bool) {
+}
+
+//────────────────────────────────────────────────────────────
+// Power
+//────────────────────────────────────────────────────────────
+
+// The host has no wake timer: a deep sleep ends the simulation.
+void halDeepSleep(uint64_t us) {
+    halLogf("deep sleep for %llu us", (unsigned long long)us);
+    exit(0);
+}
+
+bool halWokeFromSleep() {
+    return false;
+}
+
+//────────────────────────────────────────────────────────────
+// Storage and console
+//────────────────────────────────────────────────────────────
+
+void simSetStorageRoot(const char* dir) {
+    snprintf(storageRoot, sizeof(storageRoot), "%s", dir);
+}
+
+FILE* halOpenFile(const char* path, const char* mode) {
+    char fullPath[512];
+    snprintf(fullPath, sizeof(fullPath), "%s%s", storageRoot, path);
+    return fopen(fullPath, mode);
+}
+
+bool halRemoveFile(const char* path) {
+    char fullPath[512];
+    snprintf(fullPath, sizeof(fullPath), "%s%s", storageRoot, path);
+    return remove(fullPath) == 0;
+}
+
+// Settings live next to the data files as "<key>.cfg".
+static FILE* openConfig(const char* key, const char* mode) {
+    char path[64];
+    snprintf(path, sizeof(path), "/%s.cfg", key);
+    return halOpenFile(path, mode);
+}
+
+bool halConfigLoad(const char* key, void* data, size_t len) {
+    FILE* file = openConfig(key, "rb");
+    if (file == NULL)
+        return false;
+    bool ok = fseek(file, 0, SEEK_END) == 0 && ftell(file) == (long)len &&
+              fseek(file, 0, SEEK_SET) == 0 && fread(data, 1, len, file) == len;
+    fclose(file);
+    return ok;
+}
+
+bool halConfigStore(const char* key, const void* data, size_t len) {
+    FILE* file = openConfig(key, "wb");
+    if (file == NULL)
+        return false;
+    bool ok = fwrite(data, 1, len, file) == len;
+    fclose(file);
+    return ok;
+}
+
+void halConsoleWrite(const uint8_t* data, size_t len) {
+    fwrite(data, 1, len, stdout);
+}
+
+void halLogf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    putchar('\n');
+}
@@ -0,0 +1,212 @@
+// Host entry point: runs one SWV sweep against the simulated cell, writes it
+// out through the normal export paths and appends it to the sweep log in the
+// output directory (so repeated runs build up a log, as reboots would).
+//
+//   pio run -e native && .pio/build/native/program [key=value ...]
+//
+// Cell:  peak=-50 width=40 wave=0.5 baseline=0.05 slope=0.1 noise=0.01 seed=1
+// Sweep: gain=7 start=-200 end=200 amp=20 step=5 freq=10 avg=32
+//        coarse=0 window=0 (adaptive sweep: coarse step and fine window, mV)
+// Range: range=0 (auto-ranging) headroom=64 span=128 settle=2000 (us)
+//        mingain=1 maxgain=7 runs=1 (sweeps in a row, to see the gain carried over)
+// DSP:   median=0 smooth=none|ma|sg swin=0 fit=none|linear|quadratic edge=0
+// Other: out=. (directory for data.csv / data.bin), debug=0, metrics=0 (print
+//        the /metrics page), channels=1 (simulated front ends swept together;
+//        channel 0 is exported and logged, the others only summarized)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "../hal/hal.h"
+#include "../device/pstat.h"
+#include "../device/trace_log.h"
+#include "../device/sweep_log.h"
+#include "../util/metrics.h"
+#include "sim_cell.h"
+
+struct SweepArgs {
+    int gain = 7;
+    int startV = -200;
+    int endV = 200;
+    int pulseAmp = 20;
+    int stepV = 5;
+    double freq = 10.0;
+    int averages = 32;
+    int coarseStepV = 0;
+    int windowMv = 0;
+    const char* outDir = ".";
+    bool debug = false;
+    bool metrics = false;
+    int channels = 1;
+    DspConfig dsp = DSP_CONFIG_OFF;
+    AutoRangeConfig range = AUTO_RANGE_OFF;
+    int runs = 1;
+};
+
+// Index of value in names, or -1.
+static int parseName(const char* value, const char* const* names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(value, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static bool parseArg(const char* arg, SimCellConfig& cell, SweepArgs& sweep) {
+    const char* eq = strchr(arg, '=');
+    if (eq == NULL)
+        return false;
+    size_t keyLen = eq - arg;
+    const char* value = eq + 1;
+    #define KEY(name) (keyLen == strlen(name) && strncmp(arg, name, keyLen) == 0)
+    if (KEY("peak"))          cell.peakMv = atof(value);
+    else if (KEY("width"))    cell.widthMv = atof(value);
+    else if (KEY("wave"))     cell.waveUa = atof(value);
+    else if (KEY("baseline")) cell.baselineUa = atof(value);
+    else if (KEY("slope"))    cell.slopeUaPerV = atof(value);
+    else if (KEY("noise"))    cell.noiseUa = atof(value);
+    else if (KEY("seed"))     cell.seed = strtoul(value, NULL, 10);
+    else if (KEY("gain"))     sweep.gain = atoi(value);
+    else if (KEY("start"))    sweep.startV = atoi(value);
+    else if (KEY("end"))      sweep.endV = atoi(value);
+    else if (KEY("amp"))      sweep.pulseAmp = atoi(value);
+    else if (KEY("step"))     sweep.stepV = atoi(value);
+    else if (KEY("freq"))     sweep.freq = atof(value);
+    else if (KEY("avg"))      sweep.averages = atoi(value);
+    else if (KEY("coarse"))   sweep.coarseStepV = atoi(value);
+    else if (KEY("window"))   sweep.windowMv = atoi(value);
+    else if (KEY("out"))      sweep.outDir = value;
+    else if (KEY("debug"))    sweep.debug = atoi(value) != 0;
+    else if (KEY("metrics"))  sweep.metrics = atoi(value) != 0;
+    else if (KEY("channels")) sweep.channels = atoi(value);
+    else if (KEY("range"))    sweep.range.enabled = atoi(value) != 0;
+    else if (KEY("headroom")) sweep.range.headroomCodes = atoi(value);
+    else if (KEY("span"))     sweep.range.minSpanCodes = atoi(value);
+    else if (KEY("settle"))   sweep.range.settleUs = strtoul(value, NULL, 10);
+    else if (KEY("mingain"))  sweep.range.minGain = atoi(value);
+    else if (KEY("maxgain"))  sweep.range.maxGain = atoi(value);
+    else if (KEY("runs"))     sweep.runs = atoi(value);
+    else if (KEY("median"))   sweep.dsp.medianWindow = atoi(value);
+    else if (KEY("swin"))     sweep.dsp.smoothWindow = atoi(value);
+    else if (KEY("edge"))     sweep.dsp.edgePoints = atoi(value);
+    else if (KEY("smooth")) {
+        static const char* const names[] = {"none", "ma", "sg"};
+        int i = parseName(value, names, 3);
+        if (i < 0)
+            return false;
+        sweep.dsp.smoothing = i;
+    } else if (KEY("fit")) {
+        static const char* const names[] = {"none", "linear", "quadratic"};
+        int i = parseName(value, names, 3);
+        if (i < 0)
+            return false;
+        sweep.dsp.baseline = i;
+    }
+    else return false;
+    #undef KEY
+    return true;
+}
+
+static void printMetricsText(const char* text, size_t len, void*) {
+    fwrite(text, 1, len, stdout);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+int main(int argc, char** argv) {
+    SimCellConfig cell = simCellDefaults();
+    SweepArgs args;
+    for (int i = 1; i < argc; i++) {
+        if (!parseArg(argv[i], cell, args)) {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    simCellConfigure(cell);
+    simSetStorageRoot(args.outDir);
+    simSetChannelCount(args.channels);
+    setPstatDebug(args.debug);
+    pstatInit(args.gain);
+    updateAdcAverages(args.averages);
+    if (!updateDspConfig(args.dsp)) {
+        fprintf(stderr, "invalid DSP settings: %s\n", dspConfigValidate(args.dsp));
+        return 2;
+    }
+    if (!updateAutoRange(args.range)) {
+        fprintf(stderr, "invalid auto-range settings\n");
+        return 2;
+    }
+    if (sweepLogBegin())
+        setNextSweepId(sweepLogLastId() + 1);
+
+    uint8_t numChannels = pstatChannelCount();
+    SweepBuffer sweeps[HAL_MAX_CHANNELS] = {};
+    SweepBuffer* buffers[HAL_MAX_CHANNELS];
+    for (uint8_t ch = 0; ch < numChannels; ch++) {
+        buffers[ch] = &sweeps[ch];
+        updateChannelGain(ch, args.gain);
+    }
+    SweepBuffer& sweep = sweeps[0];
+    auto t0 = std::chrono::steady_clock::now();
+    for (int run = 0; run < args.runs; run++) {
+        t0 = std::chrono::steady_clock::now();
+        bool ok = args.coarseStepV != 0
+            ? runAdaptiveSWV(sweep, args.gain, args.startV, args.endV, args.pulseAmp, args.stepV,
+                             args.coarseStepV, args.windowMv, args.freq, true)
+            : runSWVChannels(buffers, (uint8_t)((1u << numChannels) - 1), args.startV, args.endV,
+                             args.pulseAmp, args.stepV, args.freq, true);
+        if (!ok) {
+            fprintf(stderr, "runSWV rejected the sweep parameters\n");
+            return 1;
+        }
+        if (args.range.enabled) {
+            uint8_t lo = 0xFF, hi = 0;
+            for (uint16_t i = 0; i < sweep.numPoints; i++) {
+                uint8_t g = sweep.samples[i].gain;
+                lo = g < lo ? g : lo;
+                hi = g > hi ? g : hi;
+            }
+            printf("run %d: started at gain %u, points at gains %u..%u, flags 0x%02x\n", run + 1,
+                   sweep.gain, lo, hi, sweep.summary.flags);
+        }
+    }
+    double sweepMs = elapsedMs(t0);
+    pstatSaveSettings();
+    while (traceLogDrainText(64) > 0) {
+    }
+
+    t0 = std::chrono::steady_clock::now();
+    writeVoltammogramToFile(sweep);
+    writeVoltammogramBinaryToFile(sweep);
+    double exportMs = elapsedMs(t0);
+    bool logged = sweepLogAppend(sweep);
+
+    printf("points: %u, sweep time (simulated): %.1f ms\n", sweep.numPoints, simElapsedUs() / 1000.0);
+    const PeakSummary& peak = sweep.summary;
+    printf("peak: %.4f uA at %.1f mV, baseline %.4f uA, height %.4f uA, concentration %.1f, flags 0x%02x\n",
+           peak.peakUa, peak.peakMv, peak.baselineUa, peak.heightUa, peak.concentration, peak.flags);
+    for (uint8_t ch = 1; ch < numChannels; ch++) {
+        const PeakSummary& p = sweeps[ch].summary;
+        printf("channel %u: peak %.4f uA at %.1f mV, height %.4f uA, concentration %.1f, flags 0x%02x\n",
+               ch, p.peakUa, p.peakMv, p.heightUa, p.concentration, p.flags);
+    }
+    printf("host time: sweep %.3f ms, export %.3f ms\n", sweepMs, exportMs);
+    printf("wrote %s/data.csv and %s/data.bin\n", args.outDir, args.outDir);
+    SweepLogStats log;
+    getSweepLogStats(log);
+    printf("sweep log: %s sweep %u; holds %u..%u (%u sweeps, %u bytes, %u segments)\n",
+           logged ? "appended" : "could not append", sweep.sweepId, log.firstId, log.lastId,
+           log.sweeps, log.bytes, log.segments);
+    if (args.metrics)
+        metricsWrite(printMetricsText, NULL);
+
+    for (uint8_t ch = 0; ch < numChannels; ch++) {
+        free(sweeps[ch].samples);
+        free(sweeps[ch].filteredPa);
+        free(sweeps[ch].pointUs);
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include "sim_cell.h"
+#include <math.h>
+#include <random>
+
+static SimCellConfig cell = simCellDefaults();
+static std::mt19937 rng(cell.seed);
+static std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+SimCellConfig simCellDefaults() {
+    SimCellConfig c;
+    c.peakMv = -50.0f;
+    c.widthMv = 40.0f;
+    c.waveUa = 0.5f;
+    c.baselineUa = 0.05f;
+    c.slopeUaPerV = 0.1f;
+    c.noiseUa = 0.01f;
+    c.seed = 1;
+    return c;
+}
+
+void simCellConfigure(const SimCellConfig& config) {
+    cell = config;
+    rng.seed(cell.seed);
+    gaussian.reset();
+}
+
+float simCellCurrent(float potentialMv) {
+    float z = (potentialMv - cell.peakMv) / cell.widthMv;
+    float wave = 0.5f * (1.0f + erff(z * (float)M_SQRT1_2));
+    return cell.baselineUa + cell.slopeUaPerV * potentialMv / 1000.0f + cell.waveUa * wave;
+}
+
+float simCellNoise(uint16_t windowSamples) {
+    if (cell.noiseUa <= 0.0f)
+        return 0.0f;
+    return gaussian(rng) * cell.noiseUa / sqrtf(windowSamples == 0 ? 1 : windowSamples);
+}
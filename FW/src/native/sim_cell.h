@@ -0,0 +1,44 @@
+#ifndef SIM_CELL_H
+#define SIM_CELL_H
+
+#include <stdint.h>
+
+// Simulated electrochemical cell for host builds. The cell follows a
+// reversible sigmoidal wave on a linear background:
+//
+//   i(E) = baseline + slope * E + wave * Phi((E - E0) / width)
+//
+// where Phi is the standard normal CDF. The SWV net current
+// i(E + amp) - i(E - amp) is then a Gaussian peak at E0 with standard
+// deviation `width` and a height of about wave * 2 * amp / (width * sqrt(2 pi)).
+// White noise is added per ADC sample and shrinks with the averaging window.
+struct SimCellConfig {
+    float peakMv;        // E0, centre of the SWV peak (mV)
+    float widthMv;       // peak standard deviation (mV)
+    float waveUa;        // height of the underlying wave (µA)
+    float baselineUa;    // background current at 0 mV (µA)
+    float slopeUaPerV;   // background slope (µA/V)
+    float noiseUa;       // RMS noise of a single ADC sample, referred to the cell (µA)
+    uint32_t seed;       // noise generator seed
+};
+
+SimCellConfig simCellDefaults();
+void simCellConfigure(const SimCellConfig& config);
+
+// Noise-free cell current (µA) at a cell potential (mV).
+float simCellCurrent(float potentialMv);
+
+// Noise (µA) of one reading averaged over windowSamples ADC samples.
+float simCellNoise(uint16_t windowSamples);
+
+// Number of simulated front-end channels (1..HAL_MAX_CHANNELS, default 1).
+void simSetChannelCount(uint8_t count);
+
+// Directory halOpenFile() resolves "/..." paths against (default ".").
+void simSetStorageRoot(const char* dir);
+
+// Virtual time (µs) since start. The simulated pacer advances it instead of
+// sleeping, so sweeps run as fast as the host allows.
+int64_t simElapsedUs();
+
+#endif // SIM_CELL_H
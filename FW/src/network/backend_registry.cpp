@@ -0,0 +1,322 @@
+#include "backend_registry.h"
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <esp_wifi.h>
+#include <esp_netif.h>
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+struct Backend {
+    char url[96];
+    uint8_t source;
+    bool named;        // the URL names a host, resolved by resolveHosts()
+    uint32_t ip;       // 0 until a named host has resolved
+    uint8_t missed;    // mDNS queries not answered since the last one that was
+};
+
+static const char* serviceName = "metallyze";
+static const char* hostName = "metallyze-sensor";
+static const char* defaultPath = "/upload";
+static const uint8_t maxLeases = ESP_WIFI_MAX_CONN_NUM;
+static const uint8_t mdnsMaxMissed = 3;
+
+// Guarded by registryLock; the publisher reads while discovery writes.
+static Backend backends[BACKEND_REGISTRY_MAX];
+static uint8_t numBackends = 0;
+static uint32_t leases[maxLeases];   // sorted
+static uint8_t numLeases = 0;
+static uint32_t apAddress = 0;
+static volatile uint32_t generation = 0;
+static portMUX_TYPE registryLock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t leasePort = 80;
+static const char* leasePath = NULL;
+static uint32_t leaseIntervalMs = 1000;
+static uint32_t mdnsIntervalMs = 30000;
+static bool mdnsStarted = false;
+static TaskHandle_t discoveryTask = NULL;
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+// Host part of an "http://host[:port]/path" URL; false if it does not fit.
+static bool urlHost(const char* url, char* host, size_t len) {
+    const char* start = url + strlen("http://");
+    size_t n = strcspn(start, ":/");
+    if (n == 0 || n >= len)
+        return false;
+    memcpy(host, start, n);
+    host[n] = '\0';
+    return true;
+}
+
+// Address of an "http://a.b.c.d[:port]/path" URL; 0 for host names.
+static uint32_t urlAddress(const char* url) {
+    char host[16];
+    IPAddress ip;
+    return urlHost(url, host, sizeof(host)) && ip.fromString(host) ? (uint32_t)ip : 0;
+}
+
+// The soft AP hands out a /24.
+static bool onApSubnet(uint32_t ip) {
+    IPAddress a(ip), b(apAddress);
+    return apAddress != 0 && a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+static bool leased(uint32_t ip) {
+    for (uint8_t i = 0; i < numLeases; i++) {
+        if (leases[i] == ip)
+            return true;
+    }
+    return false;
+}
+
+// Caller holds registryLock.
+static bool live(const Backend& b) {
+    return b.ip != 0 && (!onApSubnet(b.ip) || leased(b.ip));
+}
+
+// True if a static or mDNS backend has this address. Caller holds
+// registryLock.
+static bool hasBackendAt(uint32_t ip) {
+    for (uint8_t i = 0; i < numBackends; i++) {
+        if (backends[i].ip == ip)
+            return true;
+    }
+    return false;
+}
+
+static int findBackend(const char* url) {
+    for (uint8_t i = 0; i < numBackends; i++) {
+        if (strcmp(backends[i].url, url) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Caller holds registryLock.
+static bool addBackend(const char* url, uint8_t source, uint32_t ip) {
+    if (numBackends >= BACKEND_REGISTRY_MAX)
+        return false;
+    Backend& b = backends[numBackends++];
+    strcpy(b.url, url);
+    b.source = source;
+    b.named = ip == 0;
+    b.ip = ip;
+    b.missed = 0;
+    generation++;
+    return true;
+}
+
+// Addresses the soft AP has leased; true if one is new.
+static bool scanLeases() {
+    wifi_sta_list_t stations;
+    esp_netif_sta_list_t addresses;
+    uint32_t found[maxLeases];
+    uint8_t n = 0;
+    if (esp_wifi_ap_get_sta_list(&stations) == ESP_OK &&
+        esp_netif_get_sta_list(&stations, &addresses) == ESP_OK) {
+        for (int i = 0; i < addresses.num && n < maxLeases; i++) {
+            // A station that has not finished DHCP yet shows up as 0.0.0.0.
+            uint32_t ip = addresses.sta[i].ip.addr;
+            if (ip == 0)
+                continue;
+            uint8_t j = n++;
+            for (; j > 0 && found[j - 1] > ip; j--)
+                found[j] = found[j - 1];
+            found[j] = ip;
+        }
+    }
+    uint32_t ap = (uint32_t)WiFi.softAPIP();
+
+    bool joined = false;
+    portENTER_CRITICAL(&registryLock);
+    for (uint8_t i = 0; i < n; i++) {
+        if (!leased(found[i]))
+            joined = true;
+    }
+    if (joined || n != numLeases || ap != apAddress) {
+        memcpy(leases, found, n * sizeof(found[0]));
+        numLeases = n;
+        apAddress = ap;
+        generation++;
+    }
+    portEXIT_CRITICAL(&registryLock);
+    return joined;
+}
+
+// One mDNS query; blocks for its timeout (about 3 s).
+static void queryMdns() {
+    if (!mdnsStarted)
+        mdnsStarted = MDNS.begin(hostName);
+    if (!mdnsStarted)
+        return;
+
+    char found[BACKEND_REGISTRY_MAX][96];
+    uint32_t foundIp[BACKEND_REGISTRY_MAX];
+    uint8_t n = 0;
+    int answers = MDNS.queryService(serviceName, "tcp");
+    for (int i = 0; i < answers && n < BACKEND_REGISTRY_MAX; i++) {
+        IPAddress ip = MDNS.IP(i);
+        String path = MDNS.hasTxt(i, "path") ? MDNS.txt(i, "path") : String(defaultPath);
+        if (!path.startsWith("/"))
+            path = String(defaultPath);
+        int len = snprintf(found[n], sizeof(found[n]), "http://%s:%u%s", ip.toString().c_str(),
+                           MDNS.port(i), path.c_str());
+        if (len > 0 && (size_t)len < sizeof(found[n])) {
+            foundIp[n] = (uint32_t)ip;
+            n++;
+        }
+    }
+
+    portENTER_CRITICAL(&registryLock);
+    for (uint8_t i = 0; i < numBackends;) {
+        Backend& b = backends[i];
+        bool answered = false;
+        for (uint8_t k = 0; k < n && !answered; k++)
+            answered = strcmp(b.url, found[k]) == 0;
+        if (b.source != BACKEND_MDNS || answered) {
+            if (answered)
+                b.missed = 0;
+            i++;
+        } else if (++b.missed >= mdnsMaxMissed) {
+            backends[i] = backends[--numBackends];
+            generation++;
+        } else {
+            i++;
+        }
+    }
+    for (uint8_t k = 0; k < n; k++) {
+        if (findBackend(found[k]) < 0)
+            addBackend(found[k], BACKEND_MDNS, foundIp[k]);
+    }
+    portEXIT_CRITICAL(&registryLock);
+}
+
+// Resolves the static backends that name a host. DNS (and mDNS for .local
+// names) blocks, which is why it only happens here and never on the
+// publisher task. A failed lookup keeps the last address.
+static void resolveHosts() {
+    for (uint8_t i = 0; i < BACKEND_REGISTRY_MAX; i++) {
+        char url[sizeof(backends[0].url)];
+        portENTER_CRITICAL(&registryLock);
+        bool pending = i < numBackends && backends[i].named;
+        if (pending)
+            strcpy(url, backends[i].url);
+        portEXIT_CRITICAL(&registryLock);
+        char host[64];
+        IPAddress ip;
+        if (!pending || !urlHost(url, host, sizeof(host)) || WiFi.hostByName(host, ip) != 1 ||
+            (uint32_t)ip == 0)
+            continue;
+
+        portENTER_CRITICAL(&registryLock);
+        // mDNS may have reshuffled the table during the lookup.
+        int k = findBackend(url);
+        if (k >= 0 && backends[k].ip != (uint32_t)ip) {
+            backends[k].ip = (uint32_t)ip;
+            generation++;
+        }
+        portEXIT_CRITICAL(&registryLock);
+    }
+}
+
+// Scans leases every leaseIntervalMs; queries mDNS and resolves host names
+// every mdnsIntervalMs, and queries mDNS right after a station gets a lease,
+// as that may be a backend starting up.
+static void discoveryLoop(void* arg) {
+    uint32_t queriedAtMs = 0;
+    bool queried = false;
+    for (;;) {
+        bool joined = scanLeases();
+        bool due = !queried || millis() - queriedAtMs >= mdnsIntervalMs;
+        if (due)
+            resolveHosts();
+        if (joined || due) {
+            queryMdns();
+            queriedAtMs = millis();
+            queried = true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(leaseIntervalMs));
+    }
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+void backendRegistryBegin(uint16_t port, const char* path) {
+    leasePort = port;
+    leasePath = path;
+}
+
+bool backendRegistryAddStatic(const char* url) {
+    if (strncmp(url, "http://", strlen("http://")) != 0 || strlen(url) >= sizeof(backends[0].url))
+        return false;
+    uint32_t ip = urlAddress(url);
+    portENTER_CRITICAL(&registryLock);
+    bool ok = findBackend(url) >= 0 || addBackend(url, BACKEND_STATIC, ip);
+    portEXIT_CRITICAL(&registryLock);
+    return ok;
+}
+
+void backendRegistryStartDiscovery(uint32_t leaseScanMs, uint32_t mdnsQueryMs) {
+    leaseIntervalMs = leaseScanMs;
+    mdnsIntervalMs = mdnsQueryMs;
+    if (discoveryTask == NULL)
+        xTaskCreatePinnedToCore(discoveryLoop, "discovery", 4096, NULL, 0, &discoveryTask, 0);
+}
+
+uint32_t backendRegistryGeneration() {
+    return generation;
+}
+
+uint8_t backendRegistryLive(BackendEntry* out, uint8_t max) {
+    uint8_t n = 0;
+    uint32_t guessed[maxLeases];
+    uint8_t numGuessed = 0;
+
+    portENTER_CRITICAL(&registryLock);
+    for (uint8_t i = 0; i < numBackends && n < max; i++) {
+        if (!live(backends[i]))
+            continue;
+        strcpy(out[n].url, backends[i].url);
+        out[n].source = backends[i].source;
+        out[n].ip = backends[i].ip;
+        n++;
+    }
+    // Leased addresses no other backend names.
+    for (uint8_t i = 0; i < numLeases && leasePath != NULL; i++) {
+        if (!hasBackendAt(leases[i]))
+            guessed[numGuessed++] = leases[i];
+    }
+    portEXIT_CRITICAL(&registryLock);
+
+    for (uint8_t i = 0; i < numGuessed && n < max; i++) {
+        IPAddress ip(guessed[i]);
+        snprintf(out[n].url, sizeof(out[n].url), "http://%u.%u.%u.%u:%u%s", ip[0], ip[1], ip[2], ip[3],
+                 leasePort, leasePath);
+        out[n].source = BACKEND_DHCP;
+        out[n].ip = guessed[i];
+        n++;
+    }
+    return n;
+}
+
+uint8_t backendRegistryLiveCount() {
+    uint8_t n = 0;
+    portENTER_CRITICAL(&registryLock);
+    for (uint8_t i = 0; i < numBackends; i++) {
+        if (live(backends[i]))
+            n++;
+    }
+    for (uint8_t i = 0; i < numLeases && leasePath != NULL; i++) {
+        if (!hasBackendAt(leases[i]))
+            n++;
+    }
+    portEXIT_CRITICAL(&registryLock);
+    return n;
+}
@@ -0,0 +1,58 @@
+#ifndef BACKEND_REGISTRY_H
+#define BACKEND_REGISTRY_H
+
+#include <Arduino.h>
+
+// The set of backends sweeps are published to. Backends come from three
+// sources:
+//   static  URLs compiled in or added at run time
+//   mDNS    "_metallyze._tcp" services, re-queried every mdnsQueryMs; the
+//           TXT key "path" overrides the default upload path
+//   DHCP    stations holding a lease on the soft AP, assumed to serve
+//           http://<ip>:<port><path> unless mDNS or a static URL
+//           already names that address
+// Only live backends are handed out: an address on the soft-AP subnet is
+// live while it holds a lease, so configured backends that are not
+// connected cost nothing. Static URLs that name a host are resolved on the
+// discovery task, and are live once they have an address; the last address
+// is kept while the name fails to resolve. Services that stop answering
+// mDNS are dropped after a few queries. Whether a live backend actually
+// accepts uploads is tracked by the publisher.
+
+enum BackendSource : uint8_t {
+    BACKEND_STATIC,
+    BACKEND_MDNS,
+    BACKEND_DHCP
+};
+
+struct BackendEntry {
+    char url[96];
+    uint8_t source;   // BackendSource
+    uint32_t ip;      // address to connect to (IPAddress as uint32_t)
+};
+
+const uint8_t BACKEND_REGISTRY_MAX = 12;
+
+// Sets the port and path assumed for stations found through DHCP leases
+// (path NULL: leases only gate static and mDNS backends).
+void backendRegistryBegin(uint16_t port, const char* path);
+
+// Adds a static backend ("http://host[:port]/path"). Returns false if the
+// table is full or the URL is not http://.
+bool backendRegistryAddStatic(const char* url);
+
+// Starts the discovery task: leases are scanned every leaseScanMs; mDNS is
+// queried and host names are resolved every mdnsQueryMs, and mDNS also
+// whenever a station gets a lease. Needs the soft AP to be up.
+void backendRegistryStartDiscovery(uint32_t leaseScanMs, uint32_t mdnsQueryMs);
+
+// Changes whenever the set of live backends may have changed.
+uint32_t backendRegistryGeneration();
+
+// Copies up to max live backends to out and returns how many.
+uint8_t backendRegistryLive(BackendEntry* out, uint8_t max);
+
+// Number of live backends, without copying them.
+uint8_t backendRegistryLiveCount();
+
+#endif // BACKEND_REGISTRY_H
@@ -0,0 +1,197 @@
+#include "live_stream.h"
+#include <WebSocketsServer.h>
+#include "../device/pstat.h"
+#include "../util/spsc_queue.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+enum : uint8_t {
+    RECORD_POINT,
+    RECORD_SWEEP_START,
+    RECORD_SWEEP_END
+};
+
+struct StreamRecord {
+    uint8_t kind;
+    uint8_t channel;     // start/end records
+    uint16_t index;      // point index, or point count for start/end records
+    int16_t voltage;     // mV
+    float current;       // µA
+    int32_t timeUs;      // µs since sweep start, or the sweep ID for start/end records
+};
+
+// Produced by the sampling task, consumed by the stream task.
+static SpscQueue<StreamRecord, 256> ring;
+static volatile uint32_t droppedPoints = 0;
+
+static const uint32_t streamPollMs = 5;    // frame latency bound
+static const uint16_t maxPointsPerFrame = 32;
+static char frame[1536];
+
+static WebSocketsServer* webSocket = NULL;
+static volatile uint8_t subscriberMask = 0; // bit n set: client n subscribed
+static volatile bool enabled = false;
+
+// Sweep the streamed points belong to, from its start record (stream task).
+static uint32_t streamSweepId = 0;
+static uint8_t streamChannel = 0;
+
+static void ringPush(const StreamRecord& record) {
+    if (!ring.push(record))
+        droppedPoints++;
+}
+
+//────────────────────────────────────────────────────────────
+// Sweep Listener (runs on the sampling task)
+//────────────────────────────────────────────────────────────
+
+static inline bool streamActive() {
+    return enabled && subscriberMask != 0;
+}
+
+static void onSweepStart(uint32_t sweepId, uint8_t channel, uint16_t numPoints) {
+    if (!streamActive())
+        return;
+    StreamRecord r = {RECORD_SWEEP_START, channel, numPoints, 0, 0, (int32_t)sweepId};
+    ringPush(r);
+}
+
+static void onPoint(uint16_t index, int16_t voltage, float current, int32_t timeUs) {
+    if (!streamActive())
+        return;
+    StreamRecord r = {RECORD_POINT, 0, index, voltage, current, timeUs};
+    ringPush(r);
+}
+
+static void onSweepEnd(uint32_t sweepId, uint8_t channel, uint16_t numPoints) {
+    if (!streamActive())
+        return;
+    StreamRecord r = {RECORD_SWEEP_END, channel, numPoints, 0, 0, (int32_t)sweepId};
+    ringPush(r);
+}
+
+static const VoltammogramListener streamListener = {onSweepStart, onPoint, onSweepEnd};
+
+//────────────────────────────────────────────────────────────
+// WebSocket Side (runs on the stream task)
+//────────────────────────────────────────────────────────────
+
+static void sendToSubscribers(const char* text, size_t len) {
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX && num < 8; num++) {
+        if (subscriberMask & (1 << num))
+            webSocket->sendTXT(num, text, len);
+    }
+}
+
+static void sendSweepEvent(const char* type, const StreamRecord& r) {
+    int len = snprintf(frame, sizeof(frame),
+                       "{\"type\":\"%s\",\"sweep\":%lu,\"channel\":%u,\"points\":%u}", type,
+                       (unsigned long)(uint32_t)r.timeUs, r.channel, r.index);
+    sendToSubscribers(frame, len);
+}
+
+// Drains the ring into as few frames as possible. Points are batched up to
+// maxPointsPerFrame; start/end records close the current batch.
+static void flushRing() {
+    StreamRecord r;
+    int len = 0;
+    uint16_t batched = 0;
+
+    while (ring.pop(r)) {
+        if (r.kind != RECORD_POINT || batched == maxPointsPerFrame ||
+            len > (int)sizeof(frame) - 64) {
+            if (batched > 0) {
+                frame[len++] = ']';
+                frame[len++] = '}';
+                sendToSubscribers(frame, len);
+                batched = 0;
+                len = 0;
+            }
+        }
+
+        if (r.kind == RECORD_SWEEP_START) {
+            streamSweepId = (uint32_t)r.timeUs;
+            streamChannel = r.channel;
+            sendSweepEvent("sweep_start", r);
+        } else if (r.kind == RECORD_SWEEP_END) {
+            sendSweepEvent("sweep_end", r);
+        } else {
+            if (batched == 0) {
+                len = snprintf(frame, sizeof(frame),
+                               "{\"type\":\"points\",\"sweep\":%lu,\"channel\":%u,\"data\":[",
+                               (unsigned long)streamSweepId, streamChannel);
+            } else {
+                frame[len++] = ',';
+            }
+            len += snprintf(frame + len, sizeof(frame) - len, "[%u,%.6f,%.3f,%.3f]",
+                            r.index, r.current, r.voltage / 1000.0, r.timeUs / 1000.0);
+            batched++;
+        }
+    }
+
+    if (batched > 0) {
+        frame[len++] = ']';
+        frame[len++] = '}';
+        sendToSubscribers(frame, len);
+    }
+}
+
+static void onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
+    if (num >= 8)
+        return;
+    switch (type) {
+        case WStype_CONNECTED:
+            subscriberMask |= (1 << num);
+            break;
+        case WStype_DISCONNECTED:
+            subscriberMask &= ~(1 << num);
+            break;
+        case WStype_TEXT:
+            if (length == 9 && memcmp(payload, "subscribe", 9) == 0)
+                subscriberMask |= (1 << num);
+            else if (length == 11 && memcmp(payload, "unsubscribe", 11) == 0)
+                subscriberMask &= ~(1 << num);
+            break;
+        default:
+            break;
+    }
+}
+
+static void streamTask(void* arg) {
+    for (;;) {
+        webSocket->loop();
+        flushRing();
+        vTaskDelay(pdMS_TO_TICKS(streamPollMs));
+    }
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+void streamInit(uint16_t port) {
+    if (webSocket != NULL)
+        return;
+    webSocket = new WebSocketsServer(port);
+    webSocket->begin();
+    webSocket->onEvent(onWebSocketEvent);
+
+    addVoltammogramListener(&streamListener);
+    enabled = true;
+
+    // Core 0 hosts the WiFi stack; keep the stream task next to it.
+    xTaskCreatePinnedToCore(streamTask, "ws_stream", 4096, NULL, 1, NULL, 0);
+}
+
+void setStreamingEnabled(bool on) {
+    enabled = on;
+}
+
+bool streamingEnabled() {
+    return enabled;
+}
+
+uint32_t getStreamDroppedPoints() {
+    return droppedPoints;
+}
@@ -0,0 +1,24 @@
+#ifndef LIVE_STREAM_H
+#define LIVE_STREAM_H
+
+#include <Arduino.h>
+
+// Starts a WebSocket server on the given port and a background task that
+// pushes voltammogram points to subscribed clients while a sweep runs.
+// Clients are subscribed on connect and may send "unsubscribe"/"subscribe".
+//
+// Frames are JSON text, tagged with the sweep ID (as in the sweep log and
+// uploads) and channel of the sweep:
+//   {"type":"sweep_start","sweep":3,"channel":0,"points":81}
+//   {"type":"points","sweep":3,"channel":0,"data":[[index,current_uA,voltage_V,time_ms],...]}
+//   {"type":"sweep_end","sweep":3,"channel":0,"points":81}
+void streamInit(uint16_t port);
+
+// Enables or disables live streaming (enabled by streamInit()).
+void setStreamingEnabled(bool on);
+bool streamingEnabled();
+
+// Number of points dropped because the stream ring buffer was full.
+uint32_t getStreamDroppedPoints();
+
+#endif // LIVE_STREAM_H
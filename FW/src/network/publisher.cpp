@@ -0,0 +1,665 @@
+#include "publisher.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <lwip/sockets.h>
+#include <errno.h>
+#include "voltammogram_stream.h"
+#include "../util/metrics.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+enum : uint8_t {
+    SUB_IDLE,
+    SUB_CONNECTING,
+    SUB_SENDING,
+    SUB_READING,
+    SUB_DONE
+};
+
+struct Subscriber {
+    char url[96];
+    uint8_t source;          // BackendSource
+    char host[48];
+    char path[48];
+    uint16_t port;
+    uint32_t timeoutMs;
+    IPAddress ip;             // resolved by the registry; the task never does DNS
+
+    // Persistent connection, kept open between publishes while the backend
+    // allows it, and the circuit breaker.
+    int fd;
+    bool reusable;           // fd is connected and the last response was read in full
+    uint8_t breaker;
+    uint8_t failStreak;      // failed requests in a row
+    uint32_t backoffMs;
+    uint32_t retryAtMs;
+
+    // State of the request in flight.
+    uint8_t state;
+    uint32_t startMs;
+    bool reused;             // sent on a connection kept from an earlier publish
+    bool retried;            // already reconnected once after the kept one failed
+    char header[224];
+    size_t headerLen;
+    size_t sent;             // header + payload bytes sent
+
+    // Response parser: header lines, then Content-Length bytes of body.
+    char line[96];
+    uint8_t lineLen;
+    bool statusSeen;
+    bool headersDone;
+    bool closeAfter;         // "Connection: close", or no way to find the body's end
+    int32_t bodyLeft;        // -1 until Content-Length is seen
+    int responseStatus;
+
+    // Result of the last request.
+    int lastStatus;
+    uint32_t lastDurationMs;
+    uint32_t successes;
+    uint32_t failures;
+    uint32_t connects;
+};
+
+static const uint8_t maxSubscribers = 8;
+static Subscriber subscribers[maxSubscribers];
+static uint8_t numSubscribers = 0;
+static uint32_t requestTimeoutMs = 2000;
+static uint32_t syncedGeneration = 0;
+static bool synced = false;
+
+// Taken while the table is reshaped or copied out for getPublisherStatus().
+static portMUX_TYPE tableLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint32_t selectSliceMs = 20;
+static const uint8_t breakerThreshold = 2;
+static const uint32_t probeConnectMs = 500;
+static const uint32_t backoffMinMs = 500;
+static const uint32_t backoffMaxMs = 30000;
+static const size_t udpChunkLen = 1400;
+
+static VoltammogramFormat payloadFormat = VOLTAMMOGRAM_CSV;
+static VoltammogramFormat sendFormat = VOLTAMMOGRAM_CSV;   // of the payload in flight
+static bool summaryMode = false;
+static uint16_t fullCurveEvery = 0;
+static volatile bool fullCurveRequested = false;
+static uint8_t* payload = NULL;
+static size_t payloadLen = 0;
+static volatile bool publishing = false;
+static uint32_t sweepSequence = 0;
+static uint32_t payloadSweepId = 0;
+
+// Outcome of the last publish, until publisherTakeResult() collects it.
+static volatile bool resultPending = false;
+static uint32_t resultSweepId = 0;
+static bool resultDelivered = false;
+
+static bool udpBroadcast = false;
+static uint16_t udpPort = 0;
+static WiFiUDP udp;
+
+static TaskHandle_t publisherTask = NULL;
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions
+//────────────────────────────────────────────────────────────
+
+// Splits "http://host[:port]/path" into its parts.
+static bool parseURL(const char* url, Subscriber& s) {
+    const char* prefix = "http://";
+    if (strncmp(url, prefix, strlen(prefix)) != 0)
+        return false;
+    const char* host = url + strlen(prefix);
+    const char* slash = strchr(host, '/');
+    const char* colon = strchr(host, ':');
+    if (slash == NULL)
+        slash = host + strlen(host);
+    if (colon != NULL && colon > slash)
+        colon = NULL;
+
+    const char* hostEnd = colon ? colon : slash;
+    size_t hostLen = hostEnd - host;
+    if (hostLen == 0 || hostLen >= sizeof(s.host) || strlen(slash) >= sizeof(s.path) ||
+        strlen(url) >= sizeof(s.url))
+        return false;
+
+    memcpy(s.host, host, hostLen);
+    s.host[hostLen] = '\0';
+    s.port = colon ? atoi(colon + 1) : 80;
+    strcpy(s.path, *slash ? slash : "/");
+    strcpy(s.url, url);
+    return s.port != 0;
+}
+
+static const char* contentType() {
+    switch (sendFormat) {
+        case VOLTAMMOGRAM_BINARY:  return SWVB_CONTENT_TYPE;
+        case VOLTAMMOGRAM_SUMMARY: return "application/json";
+        default:                   return "text/csv";
+    }
+}
+
+// In summary mode only every fullCurveEvery-th sweep, or one requested
+// explicitly, goes out as a full curve.
+static VoltammogramFormat nextPayloadFormat() {
+    if (!summaryMode)
+        return payloadFormat;
+    if (fullCurveRequested || (fullCurveEvery > 0 && sweepSequence % fullCurveEvery == 0)) {
+        fullCurveRequested = false;
+        return payloadFormat;
+    }
+    return VOLTAMMOGRAM_SUMMARY;
+}
+
+static void closeConnection(Subscriber& s) {
+    if (s.fd >= 0) {
+        close(s.fd);
+        s.fd = -1;
+    }
+    s.reusable = false;
+}
+
+// A kept connection is usable if the backend has neither closed it nor sent
+// anything unsolicited since the last response.
+static bool connectionAlive(Subscriber& s) {
+    if (s.fd < 0 || !s.reusable)
+        return false;
+    char c;
+    int n = recv(s.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void openBreaker(Subscriber& s) {
+    s.breaker = BREAKER_OPEN;
+    s.backoffMs = s.backoffMs == 0 ? backoffMinMs : 2 * s.backoffMs;
+    if (s.backoffMs > backoffMaxMs)
+        s.backoffMs = backoffMaxMs;
+    s.retryAtMs = millis() + s.backoffMs;
+}
+
+static void finishRequest(Subscriber& s, int status) {
+    // Keep the connection only after a complete response the backend did
+    // not ask to close.
+    if (!(s.headersDone && s.bodyLeft <= 0 && !s.closeAfter))
+        closeConnection(s);
+    s.state = SUB_DONE;
+    s.lastStatus = status;
+    s.lastDurationMs = millis() - s.startMs;
+    if (status >= 200 && status < 300) {
+        s.successes++;
+    } else if (status != PUBLISH_ERR_BACKOFF) {
+        s.failures++;
+    }
+
+    if (status == PUBLISH_ERR_BACKOFF)
+        return;
+    // Any answer short of a server error shows the backend is up, even if
+    // it refused this payload.
+    if (status > 0 && status < 500) {
+        s.breaker = BREAKER_CLOSED;
+        s.failStreak = 0;
+        s.backoffMs = 0;
+        return;
+    }
+    if (s.failStreak < UINT8_MAX)
+        s.failStreak++;
+    if (s.breaker == BREAKER_HALF_OPEN || s.failStreak >= breakerThreshold)
+        openBreaker(s);
+}
+
+static void openConnection(Subscriber& s) {
+    s.reused = false;
+    s.fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s.fd < 0) {
+        finishRequest(s, PUBLISH_ERR_CONNECT);
+        return;
+    }
+    s.connects++;
+    fcntl(s.fd, F_SETFL, fcntl(s.fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s.port);
+    addr.sin_addr.s_addr = (uint32_t)s.ip;
+    if (connect(s.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        finishRequest(s, PUBLISH_ERR_CONNECT);
+        return;
+    }
+    s.state = SUB_CONNECTING;
+}
+
+static void resetResponse(Subscriber& s) {
+    s.sent = 0;
+    s.lineLen = 0;
+    s.statusSeen = false;
+    s.headersDone = false;
+    s.closeAfter = false;
+    s.bodyLeft = -1;
+    s.responseStatus = 0;
+}
+
+// Network error on the request in flight. A kept connection the backend
+// dropped while idle fails like this before any response; that is retried
+// once on a fresh connection.
+static void failRequest(Subscriber& s, int error) {
+    if (s.reused && !s.retried && !s.statusSeen) {
+        closeConnection(s);
+        s.retried = true;
+        resetResponse(s);
+        openConnection(s);
+        return;
+    }
+    finishRequest(s, error);
+}
+
+static void beginRequest(Subscriber& s) {
+    s.startMs = millis();
+    s.retried = false;
+    resetResponse(s);
+
+    if (s.breaker == BREAKER_OPEN) {
+        if ((int32_t)(s.startMs - s.retryAtMs) < 0) {
+            finishRequest(s, PUBLISH_ERR_BACKOFF);
+            return;
+        }
+        s.breaker = BREAKER_HALF_OPEN;
+    }
+
+    s.headerLen = snprintf(s.header, sizeof(s.header),
+                           "POST %s HTTP/1.1\r\n"
+                           "Host: %s\r\n"
+                           "Content-Type: %s\r\n"
+                           "Content-Length: %u\r\n"
+                           "Connection: keep-alive\r\n\r\n",
+                           s.path, s.host, contentType(), (unsigned)payloadLen);
+
+    if (connectionAlive(s)) {
+        s.reused = true;
+        s.state = SUB_SENDING;
+        return;
+    }
+    closeConnection(s);
+    openConnection(s);
+}
+
+// Sends as much of header + payload as the socket accepts.
+static void pumpSend(Subscriber& s) {
+    while (s.sent < s.headerLen + payloadLen) {
+        const uint8_t* data;
+        size_t len;
+        if (s.sent < s.headerLen) {
+            data = (const uint8_t*)s.header + s.sent;
+            len = s.headerLen - s.sent;
+        } else {
+            data = payload + (s.sent - s.headerLen);
+            len = payloadLen - (s.sent - s.headerLen);
+        }
+        int n = send(s.fd, data, len, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                failRequest(s, PUBLISH_ERR_SEND);
+            return;
+        }
+        s.sent += n;
+    }
+    s.state = SUB_READING;
+}
+
+static bool headerIs(const char* line, const char* name) {
+    return strncasecmp(line, name, strlen(name)) == 0;
+}
+
+// One complete response header line (without CRLF).
+static void parseHeaderLine(Subscriber& s) {
+    s.line[s.lineLen] = '\0';
+    if (!s.statusSeen) {
+        const char* code = strchr(s.line, ' ');
+        s.responseStatus = code ? atoi(code + 1) : 0;
+        s.statusSeen = true;
+    } else if (s.lineLen == 0) {
+        s.headersDone = true;
+        // Without a length the body runs until the backend closes.
+        if (s.bodyLeft < 0) {
+            s.closeAfter = true;
+            s.bodyLeft = 0;
+        }
+    } else if (headerIs(s.line, "Content-Length:")) {
+        s.bodyLeft = atol(s.line + strlen("Content-Length:"));
+    } else if (headerIs(s.line, "Connection:") && strstr(s.line, "close") != NULL) {
+        s.closeAfter = true;
+    } else if (headerIs(s.line, "Transfer-Encoding:")) {
+        s.closeAfter = true;   // chunked bodies are not parsed
+    }
+    s.lineLen = 0;
+}
+
+// Reads the response: status line and headers, then discards the body so
+// the connection is ready for the next request. Never waits for data.
+static void pumpRead(Subscriber& s) {
+    uint8_t chunk[128];
+    while (!(s.headersDone && s.bodyLeft <= 0)) {
+        size_t want = sizeof(chunk);
+        if (s.headersDone && (size_t)s.bodyLeft < want)
+            want = s.bodyLeft;
+        int n = recv(s.fd, chunk, want, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                failRequest(s, PUBLISH_ERR_RESPONSE);
+            return;
+        }
+        if (n == 0) {
+            // Closed by the backend: fine once the status is known.
+            s.closeAfter = true;
+            if (s.statusSeen && s.responseStatus > 0)
+                finishRequest(s, s.responseStatus);
+            else
+                failRequest(s, PUBLISH_ERR_RESPONSE);
+            return;
+        }
+        int i = 0;
+        while (i < n && !s.headersDone) {
+            char c = chunk[i++];
+            if (c == '\n')
+                parseHeaderLine(s);
+            else if (c != '\r' && s.lineLen < sizeof(s.line) - 1)
+                s.line[s.lineLen++] = c;   // longer lines are truncated
+        }
+        if (s.headersDone)
+            s.bodyLeft -= (n - i);
+    }
+    finishRequest(s, s.responseStatus > 0 ? s.responseStatus : PUBLISH_ERR_RESPONSE);
+}
+
+static bool hasSubscriber(const char* url) {
+    for (uint8_t i = 0; i < numSubscribers; i++) {
+        if (strcmp(subscribers[i].url, url) == 0)
+            return true;
+    }
+    return false;
+}
+
+static const BackendEntry* findLive(const BackendEntry* live, uint8_t n, const char* url) {
+    for (uint8_t i = 0; i < n; i++) {
+        if (strcmp(live[i].url, url) == 0)
+            return &live[i];
+    }
+    return NULL;
+}
+
+// Appends a backend new to the registry, half-open so its first request is
+// a probe.
+static void addSubscriber(const BackendEntry& backend) {
+    if (numSubscribers >= maxSubscribers)
+        return;
+    Subscriber s = Subscriber();
+    if (!parseURL(backend.url, s))
+        return;
+    s.source = backend.source;
+    s.fd = -1;
+    s.timeoutMs = requestTimeoutMs;
+    s.ip = IPAddress(backend.ip);
+    s.breaker = BREAKER_HALF_OPEN;
+    portENTER_CRITICAL(&tableLock);
+    subscribers[numSubscribers++] = s;
+    portEXIT_CRITICAL(&tableLock);
+}
+
+// Follows the registry: subscribers whose backend is no longer live are
+// dropped with their connection, new live backends are added, and a host
+// that resolved to a new address is reconnected. Runs on the publisher task
+// between publishes, so no request is in flight.
+static void syncSubscribers() {
+    uint32_t generation = backendRegistryGeneration();
+    if (synced && generation == syncedGeneration)
+        return;
+    BackendEntry live[maxSubscribers];
+    uint8_t n = backendRegistryLive(live, maxSubscribers);
+    syncedGeneration = generation;
+    synced = true;
+
+    for (uint8_t i = 0; i < numSubscribers;) {
+        const BackendEntry* backend = findLive(live, n, subscribers[i].url);
+        if (backend != NULL) {
+            if ((uint32_t)subscribers[i].ip != backend->ip) {
+                closeConnection(subscribers[i]);
+                subscribers[i].ip = IPAddress(backend->ip);
+            }
+            i++;
+            continue;
+        }
+        closeConnection(subscribers[i]);
+        portENTER_CRITICAL(&tableLock);
+        subscribers[i] = subscribers[--numSubscribers];
+        portEXIT_CRITICAL(&tableLock);
+    }
+    for (uint8_t k = 0; k < n; k++) {
+        if (!hasSubscriber(live[k].url))
+            addSubscriber(live[k]);
+    }
+}
+
+// Drives all requests to completion with one select() loop. Returns true if
+// at least one backend accepted the payload.
+static bool publishHTTP() {
+    for (uint8_t i = 0; i < numSubscribers; i++)
+        beginRequest(subscribers[i]);
+
+    for (;;) {
+        fd_set readSet, writeSet;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        int maxFd = -1;
+        for (uint8_t i = 0; i < numSubscribers; i++) {
+            Subscriber& s = subscribers[i];
+            if (s.state == SUB_CONNECTING || s.state == SUB_SENDING)
+                FD_SET(s.fd, &writeSet);
+            else if (s.state == SUB_READING)
+                FD_SET(s.fd, &readSet);
+            else
+                continue;
+            if (s.fd > maxFd)
+                maxFd = s.fd;
+        }
+        if (maxFd < 0)
+            break;
+
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = selectSliceMs * 1000;
+        select(maxFd + 1, &readSet, &writeSet, NULL, &tv);
+
+        uint32_t now = millis();
+        for (uint8_t i = 0; i < numSubscribers; i++) {
+            Subscriber& s = subscribers[i];
+            if (s.state == SUB_IDLE || s.state == SUB_DONE)
+                continue;
+
+            if (s.state == SUB_CONNECTING && FD_ISSET(s.fd, &writeSet)) {
+                int err = 0;
+                socklen_t errLen = sizeof(err);
+                getsockopt(s.fd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+                if (err != 0) {
+                    finishRequest(s, PUBLISH_ERR_CONNECT);
+                    continue;
+                }
+                s.state = SUB_SENDING;
+            }
+            if (s.state == SUB_SENDING && FD_ISSET(s.fd, &writeSet))
+                pumpSend(s);
+            else if (s.state == SUB_READING && FD_ISSET(s.fd, &readSet))
+                pumpRead(s);
+
+            // A probe that cannot even connect quickly is not worth waiting for.
+            if (s.state == SUB_CONNECTING && s.breaker == BREAKER_HALF_OPEN &&
+                now - s.startMs > probeConnectMs)
+                finishRequest(s, PUBLISH_ERR_CONNECT);
+            else if (s.state != SUB_DONE && now - s.startMs > s.timeoutMs)
+                finishRequest(s, PUBLISH_ERR_TIMEOUT);
+        }
+    }
+
+    bool delivered = false;
+    for (uint8_t i = 0; i < numSubscribers; i++) {
+        Subscriber& s = subscribers[i];
+        if (s.lastStatus >= 200 && s.lastStatus < 300)
+            delivered = true;
+        if (s.lastStatus == PUBLISH_ERR_BACKOFF)
+            continue;
+        Serial.print("Publish to ");
+        Serial.print(s.url);
+        Serial.print(": ");
+        Serial.print(s.lastStatus);
+        Serial.print(" in ");
+        Serial.print(s.lastDurationMs);
+        Serial.println(" ms");
+    }
+    return delivered;
+}
+
+static void publishUDP() {
+    uint16_t chunks = (payloadLen + udpChunkLen - 1) / udpChunkLen;
+    IPAddress broadcast = WiFi.softAPBroadcastIP();
+    for (uint16_t c = 0; c < chunks; c++) {
+        uint8_t header[12] = {'S', 'W', 'V', 'U'};
+        for (uint8_t b = 0; b < 4; b++)
+            header[4 + b] = (uint8_t)(sweepSequence >> (8 * b));
+        header[8] = (uint8_t)c;
+        header[9] = (uint8_t)(c >> 8);
+        header[10] = (uint8_t)chunks;
+        header[11] = (uint8_t)(chunks >> 8);
+
+        size_t offset = (size_t)c * udpChunkLen;
+        size_t len = payloadLen - offset < udpChunkLen ? payloadLen - offset : udpChunkLen;
+        udp.beginPacket(broadcast, udpPort);
+        udp.write(header, sizeof(header));
+        udp.write(payload + offset, len);
+        udp.endPacket();
+    }
+}
+
+static void publisherLoop(void* arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t start = metricsStart();
+        syncSubscribers();
+        if (udpBroadcast)
+            publishUDP();
+        bool delivered = publishHTTP();
+        metricsEnd(PHASE_UPLOAD, start);
+
+        // UDP is fire-and-forget; with no HTTP backends it counts as delivered.
+        resultSweepId = payloadSweepId;
+        resultDelivered = delivered || (numSubscribers == 0 && udpBroadcast);
+        resultPending = true;
+
+        free(payload);
+        payload = NULL;
+        payloadLen = 0;
+        publishing = false;
+    }
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+void publisherInit(VoltammogramFormat format, uint32_t timeoutMs) {
+    payloadFormat = format;
+    requestTimeoutMs = timeoutMs;
+    if (publisherTask == NULL)
+        xTaskCreatePinnedToCore(publisherLoop, "publisher", 4096, NULL, 1, &publisherTask, 0);
+}
+
+void publisherSetUdpBroadcast(bool on, uint16_t port) {
+    udpBroadcast = on;
+    udpPort = port;
+}
+
+void publisherSetSummaryMode(bool on, uint16_t fullCurveInterval) {
+    summaryMode = on;
+    fullCurveEvery = fullCurveInterval;
+}
+
+void publisherRequestFullCurve() {
+    fullCurveRequested = true;
+}
+
+bool publishSweep(const SweepBuffer& sweep, uint32_t waitMs) {
+    uint32_t start = millis();
+    while (publishing) {
+        if (millis() - start >= waitMs)
+            return false;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    // Render the payload once; every subscriber sends from this copy, and
+    // the sample buffers are free for the next sweep as soon as we return.
+    uint32_t renderStart = metricsStart();
+    sendFormat = nextPayloadFormat();
+    VoltammogramStream stream(sweep, sendFormat);
+    payloadLen = stream.size();
+    payload = (uint8_t*)malloc(payloadLen);
+    if (payload == NULL) {
+        payloadLen = 0;
+        return false;
+    }
+    stream.readBytes((char*)payload, payloadLen);
+    metricsEnd(PHASE_PUBLISH_RENDER, renderStart);
+
+    payloadSweepId = sweep.sweepId;
+    sweepSequence++;
+    publishing = true;
+    xTaskNotifyGive(publisherTask);
+    return true;
+}
+
+bool publishStoredSweep(uint32_t sweepId, uint8_t* swvb, size_t len) {
+    if (publishing) {
+        free(swvb);
+        return false;
+    }
+    sendFormat = VOLTAMMOGRAM_BINARY;
+    payload = swvb;
+    payloadLen = len;
+    payloadSweepId = sweepId;
+    sweepSequence++;
+    publishing = true;
+    xTaskNotifyGive(publisherTask);
+    return true;
+}
+
+bool publisherTakeResult(uint32_t& sweepId, bool& delivered) {
+    if (!resultPending || publishing)
+        return false;
+    sweepId = resultSweepId;
+    delivered = resultDelivered;
+    resultPending = false;
+    return true;
+}
+
+bool publisherIdle() {
+    return !publishing;
+}
+
+uint8_t getPublisherSubscriberCount() {
+    return numSubscribers;
+}
+
+bool getPublisherStatus(uint8_t index, PublisherStatus& status) {
+    portENTER_CRITICAL(&tableLock);
+    bool ok = index < numSubscribers;
+    if (ok) {
+        const Subscriber& s = subscribers[index];
+        memcpy(status.url, s.url, sizeof(status.url));
+        status.source = s.source;
+        status.breaker = s.breaker;
+        status.lastStatus = s.lastStatus;
+        status.lastDurationMs = s.lastDurationMs;
+        status.successes = s.successes;
+        status.failures = s.failures;
+        status.connects = s.connects;
+    }
+    portEXIT_CRITICAL(&tableLock);
+    return ok;
+}
@@ -0,0 +1,89 @@
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <Arduino.h>
+#include "../device/pstat.h"
+#include "backend_registry.h"
+
+// Publishes completed sweeps to every live backend of the registry. The
+// payload is rendered once per sweep and sent to all subscribers concurrently
+// from a single task using non-blocking sockets, so a publish takes as long
+// as the slowest backend (bounded by its timeout) rather than the sum of all
+// of them. Connections are kept alive between publishes and reopened lazily.
+//
+// Each subscriber has a circuit breaker. Two failures in a row (network
+// errors or 5xx responses) open it, and the backend is skipped for an
+// exponentially growing backoff (0.5 s doubling up to 30 s). The next publish
+// after that is a probe, which gets only a short connect timeout; success
+// closes the breaker, failure opens it again. Backends new to the registry
+// start with a probe too, so one that is down delays a publish by at most
+// the probe timeout, once per backoff.
+
+// Result codes reported in PublisherStatus::lastStatus besides HTTP codes.
+enum PublishError {
+    PUBLISH_PENDING       = 0,
+    PUBLISH_ERR_CONNECT   = -2,
+    PUBLISH_ERR_SEND      = -3,
+    PUBLISH_ERR_RESPONSE  = -4,
+    PUBLISH_ERR_TIMEOUT   = -5,
+    PUBLISH_ERR_BACKOFF   = -6     // skipped: breaker open
+};
+
+enum BreakerState : uint8_t {
+    BREAKER_CLOSED,      // healthy: every publish goes out
+    BREAKER_OPEN,        // failing: skipped until the backoff is over
+    BREAKER_HALF_OPEN    // the next request is a probe
+};
+
+struct PublisherStatus {
+    char url[96];
+    uint8_t source;          // BackendSource
+    uint8_t breaker;         // BreakerState
+    int lastStatus;          // HTTP status code, or a PublishError
+    uint32_t lastDurationMs;
+    uint32_t successes;
+    uint32_t failures;
+    uint32_t connects;       // TCP connections opened; stays low while keep-alive works
+};
+
+// Starts the publisher task. Payloads are rendered in the given format;
+// each request is abandoned after timeoutMs. Subscribers follow the live
+// backends of the registry (the first eight), checked before every publish.
+void publisherInit(VoltammogramFormat format, uint32_t timeoutMs);
+
+// Additionally (or, with no HTTP subscribers, only) broadcasts each payload
+// as a set of UDP datagrams on the soft-AP subnet. Datagram layout:
+//   "SWVU", sweep sequence (uint32 LE), chunk index (uint16 LE),
+//   chunk count (uint16 LE), payload bytes (at most 1400).
+void publisherSetUdpBroadcast(bool on, uint16_t port);
+
+// Summary mode: publish only SweepBuffer::summary as a JSON object
+// (Content-Type application/json). Every fullCurveInterval-th sweep
+// (0 = never), and the sweep after publisherRequestFullCurve(), still goes
+// out as the full curve in the format given to publisherInit().
+void publisherSetSummaryMode(bool on, uint16_t fullCurveInterval);
+void publisherRequestFullCurve();
+
+// Snapshots a sweep and hands it to the publisher task; returns
+// immediately after the snapshot. If the previous publish is still running,
+// waits up to waitMs for it and returns false if it does not finish.
+bool publishSweep(const SweepBuffer& sweep, uint32_t waitMs);
+
+// Publishes an SWVB payload read back from the sweep log, taking ownership
+// of the malloc()ed buffer. Returns false (and frees it) if a publish is
+// still in flight.
+bool publishStoredSweep(uint32_t sweepId, uint8_t* swvb, size_t len);
+
+// Collects the outcome of the last finished publish: the sweep it carried
+// and whether at least one backend accepted it. Returns false if there is
+// no new outcome.
+bool publisherTakeResult(uint32_t& sweepId, bool& delivered);
+
+// True while no publish is in flight.
+bool publisherIdle();
+
+// Subscribers as of the last publish; the status is a copy.
+uint8_t getPublisherSubscriberCount();
+bool getPublisherStatus(uint8_t index, PublisherStatus& status);
+
+#endif // PUBLISHER_H
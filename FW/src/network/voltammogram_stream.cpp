@@ -0,0 +1,62 @@
+#include "voltammogram_stream.h"
+
+VoltammogramStream::VoltammogramStream(const SweepBuffer& sweep, VoltammogramFormat format)
+    : sweep(sweep), format(format) {
+    // Sizing pass: format every row once to get an exact Content-Length.
+    totalSize = 0;
+    rewind();
+    while (cursor.row <= sweep.numPoints)
+        totalSize += formatVoltammogramRow(sweep, format, cursor, line, sizeof(line));
+
+    rewind();
+}
+
+void VoltammogramStream::rewind() {
+    lineLen = 0;
+    linePos = 0;
+    cursor.row = 0;
+    cursor.timeUs = 0;
+    consumed = 0;
+}
+
+// Formats the next row once the current one has been consumed.
+bool VoltammogramStream::fillLine() {
+    while (linePos >= lineLen) {
+        if (cursor.row > sweep.numPoints)
+            return false;
+        lineLen = formatVoltammogramRow(sweep, format, cursor, line, sizeof(line));
+        linePos = 0;
+    }
+    return true;
+}
+
+int VoltammogramStream::available() {
+    return totalSize - consumed;
+}
+
+int VoltammogramStream::read() {
+    if (!fillLine())
+        return -1;
+    consumed++;
+    return (uint8_t)line[linePos++];
+}
+
+int VoltammogramStream::peek() {
+    if (!fillLine())
+        return -1;
+    return (uint8_t)line[linePos];
+}
+
+size_t VoltammogramStream::readBytes(char* buffer, size_t length) {
+    size_t copied = 0;
+    while (copied < length && fillLine()) {
+        size_t n = lineLen - linePos;
+        if (n > length - copied)
+            n = length - copied;
+        memcpy(buffer + copied, line + linePos, n);
+        linePos += n;
+        copied += n;
+    }
+    consumed += copied;
+    return copied;
+}
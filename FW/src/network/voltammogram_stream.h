@@ -0,0 +1,43 @@
+#ifndef VOLTAMMOGRAM_STREAM_H
+#define VOLTAMMOGRAM_STREAM_H
+
+#include <Arduino.h>
+#include "../device/pstat.h"
+
+// Content-Type of SWVB binary uploads (see device/voltammogram_format.h).
+#define SWVB_CONTENT_TYPE "application/vnd.metallyze.swvb"
+
+// Read-only Stream that renders a sweep in a given export format
+// straight from the in-memory sample buffer, one row at a time, with the
+// payload size known up front and without round-tripping through SPIFFS.
+class VoltammogramStream : public Stream {
+public:
+    VoltammogramStream(const SweepBuffer& sweep, VoltammogramFormat format);
+
+    // Total payload size in bytes.
+    size_t size() const { return totalSize; }
+
+    // Restarts the stream from the header row.
+    void rewind();
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char* buffer, size_t length) override;
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+private:
+    bool fillLine();
+
+    const SweepBuffer& sweep;
+    VoltammogramFormat format;
+    char line[VOLTAMMOGRAM_ROW_MAX_LEN];   // current row, in any format
+    size_t lineLen;
+    size_t linePos;
+    VoltammogramCursor cursor;
+    size_t totalSize;
+    size_t consumed;
+};
+
+#endif // VOLTAMMOGRAM_STREAM_H
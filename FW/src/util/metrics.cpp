@@ -0,0 +1,152 @@
+#include "metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "../hal/hal.h"
+
+//────────────────────────────────────────────────────────────
+// Static Variables and Constants (Private to this module)
+//────────────────────────────────────────────────────────────
+
+// Histogram bucket upper bounds: 1 µs to ~1 s in powers of 4, plus +Inf.
+static const uint8_t numBuckets = 11;
+static const uint32_t bucketLimitUs[numBuckets] = {
+    1, 4, 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576
+};
+
+struct Histogram {
+    uint32_t count;
+    uint64_t sum;                // cycles for phases, µs for jitter
+    uint32_t maxUs;
+    uint32_t buckets[numBuckets + 1];   // non-cumulative; last is +Inf
+};
+
+static const char* phaseNames[NUM_METRIC_PHASES] = {
+    "sweep_setup", "sweep", "lmp_bias", "dac_write", "tick_wait", "adc_read", "point_save",
+    "file_write", "serial_dump", "publish_render", "upload", "http_server"
+};
+
+static const char* counterNames[NUM_METRIC_COUNTERS] = {
+    "sweeps_total", "points_total", "missed_ticks_total", "lmp_i2c_writes_total",
+    "gain_switches_total"
+};
+
+static const char* gaugeNames[NUM_METRIC_GAUGES] = {
+    "free_heap_bytes", "min_free_heap_bytes", "largest_free_block_bytes",
+    "last_sweep_max_jitter_us", "trace_dropped_records", "stream_dropped_points",
+    "wake_to_first_sample_us", "live_backends"
+};
+
+static Histogram phases[NUM_METRIC_PHASES];
+static Histogram jitter;
+static uint32_t counters[NUM_METRIC_COUNTERS];
+static uint32_t gauges[NUM_METRIC_GAUGES];
+
+//────────────────────────────────────────────────────────────
+// Internal Helper Functions (Private, Static)
+//────────────────────────────────────────────────────────────
+
+static inline void addSample(Histogram& h, uint32_t us, uint64_t weight) {
+    uint8_t b = 0;
+    while (b < numBuckets && us > bucketLimitUs[b])
+        b++;
+    h.buckets[b]++;
+    h.count++;
+    h.sum += weight;
+    if (us > h.maxUs)
+        h.maxUs = us;
+}
+
+struct Writer {
+    void (*emit)(const char*, size_t, void*);
+    void* ctx;
+    char line[128];
+};
+
+static void writef(Writer& w, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void writef(Writer& w, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w.line, sizeof(w.line), fmt, args);
+    va_end(args);
+    if (n > 0)
+        w.emit(w.line, (size_t)n < sizeof(w.line) ? n : sizeof(w.line) - 1, w.ctx);
+}
+
+static void writeHistogram(Writer& w, const char* name, const char* label, const Histogram& h,
+                           double sumSeconds) {
+    uint32_t cumulative = 0;
+    for (uint8_t b = 0; b < numBuckets; b++) {
+        cumulative += h.buckets[b];
+        writef(w, "metallyze_%s_bucket{%sle=\"%.7g\"} %lu\n", name, label,
+               bucketLimitUs[b] / 1e6, (unsigned long)cumulative);
+    }
+    writef(w, "metallyze_%s_bucket{%sle=\"+Inf\"} %lu\n", name, label, (unsigned long)h.count);
+    // Drop the trailing comma of the label list for _sum/_count.
+    char plain[48] = "";
+    if (*label) {
+        snprintf(plain, sizeof(plain), "{%s", label);
+        plain[strlen(plain) - 1] = '}';
+    }
+    writef(w, "metallyze_%s_sum%s %.6f\n", name, plain, sumSeconds);
+    writef(w, "metallyze_%s_count%s %lu\n", name, plain, (unsigned long)h.count);
+}
+
+//────────────────────────────────────────────────────────────
+// Public Functions
+//────────────────────────────────────────────────────────────
+
+uint32_t metricsStart() {
+    return halCycleCount();
+}
+
+void metricsEnd(MetricPhase phase, uint32_t start) {
+    uint32_t cycles = halCycleCount() - start;
+    addSample(phases[phase], cycles / halCyclesPerUs(), cycles);
+}
+
+void metricsHalfPeriodJitter(int32_t deviationUs) {
+    uint32_t us = deviationUs < 0 ? -deviationUs : deviationUs;
+    addSample(jitter, us, us);
+}
+
+void metricsCount(MetricCounter counter, uint32_t n) {
+    counters[counter] += n;
+}
+
+void metricsSetGauge(MetricGauge gauge, uint32_t value) {
+    gauges[gauge] = value;
+}
+
+void metricsWrite(void (*emit)(const char* text, size_t len, void* ctx), void* ctx) {
+    Writer w;
+    w.emit = emit;
+    w.ctx = ctx;
+    double cyclesPerSecond = halCyclesPerUs() * 1e6;
+
+    writef(w, "# HELP metallyze_phase_seconds Duration of firmware phases.\n");
+    writef(w, "# TYPE metallyze_phase_seconds histogram\n");
+    for (uint8_t p = 0; p < NUM_METRIC_PHASES; p++) {
+        char label[40];
+        snprintf(label, sizeof(label), "phase=\"%s\",", phaseNames[p]);
+        writeHistogram(w, "phase_seconds", label, phases[p], phases[p].sum / cyclesPerSecond);
+    }
+    writef(w, "# HELP metallyze_phase_max_seconds Longest duration seen per phase.\n");
+    writef(w, "# TYPE metallyze_phase_max_seconds gauge\n");
+    for (uint8_t p = 0; p < NUM_METRIC_PHASES; p++)
+        writef(w, "metallyze_phase_max_seconds{phase=\"%s\"} %g\n", phaseNames[p], phases[p].maxUs / 1e6);
+
+    writef(w, "# HELP metallyze_halfperiod_jitter_seconds |actual - requested| half-period.\n");
+    writef(w, "# TYPE metallyze_halfperiod_jitter_seconds histogram\n");
+    writeHistogram(w, "halfperiod_jitter_seconds", "", jitter, jitter.sum / 1e6);
+
+    for (uint8_t c = 0; c < NUM_METRIC_COUNTERS; c++) {
+        writef(w, "# TYPE metallyze_%s counter\n", counterNames[c]);
+        writef(w, "metallyze_%s %lu\n", counterNames[c], (unsigned long)counters[c]);
+    }
+    for (uint8_t g = 0; g < NUM_METRIC_GAUGES; g++) {
+        writef(w, "# TYPE metallyze_%s gauge\n", gaugeNames[g]);
+        writef(w, "metallyze_%s %lu\n", gaugeNames[g], (unsigned long)gauges[g]);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Runtime telemetry: per-phase duration histograms taken from the CPU cycle
+// counter, event counters and gauges, rendered in the Prometheus text
+// exposition format. Each phase is recorded from a single task, so updates
+// need no locking; a scrape may see a phase mid-update, which only skews
+// that sample.
+
+enum MetricPhase {
+    PHASE_SWEEP_SETUP,    // runSWV() until the first half-period starts
+    PHASE_SWEEP,          // whole runSWV()
+    PHASE_LMP_BIAS,       // LMP91000 bias sign and level (I2C)
+    PHASE_DAC_WRITE,
+    PHASE_TICK_WAIT,      // slack until the half-period ends
+    PHASE_ADC_READ,
+    PHASE_POINT_SAVE,     // storing, analysing and publishing a point to listeners
+    PHASE_FILE_WRITE,     // exporting a sweep to flash
+    PHASE_SERIAL_DUMP,
+    PHASE_PUBLISH_RENDER, // snapshotting a sweep for the publisher
+    PHASE_UPLOAD,         // one publish to all backends
+    PHASE_HTTP_SERVER,    // one request in the async web server
+    NUM_METRIC_PHASES
+};
+
+enum MetricCounter {
+    COUNTER_SWEEPS,
+    COUNTER_POINTS,
+    COUNTER_MISSED_TICKS,
+    COUNTER_LMP_WRITES,   // LMP91000 register writes on the I2C bus
+    COUNTER_GAIN_SWITCHES,   // TIA gain changes made by auto-ranging
+    NUM_METRIC_COUNTERS
+};
+
+enum MetricGauge {
+    GAUGE_FREE_HEAP,
+    GAUGE_MIN_FREE_HEAP,
+    GAUGE_LARGEST_FREE_BLOCK,
+    GAUGE_LAST_SWEEP_MAX_JITTER_US,
+    GAUGE_TRACE_DROPPED,
+    GAUGE_STREAM_DROPPED,
+    GAUGE_WAKE_TO_FIRST_SAMPLE_US,   // boot to the first ADC sample
+    GAUGE_LIVE_BACKENDS,             // backends the registry hands to the publisher
+    NUM_METRIC_GAUGES
+};
+
+// Cycle count to pass to metricsEnd().
+uint32_t metricsStart();
+
+// Records the time since `start` (from metricsStart()) for a phase.
+void metricsEnd(MetricPhase phase, uint32_t start);
+
+// Records the deviation (µs, either sign) of one actual half-period from
+// the requested one.
+void metricsHalfPeriodJitter(int32_t deviationUs);
+
+void metricsCount(MetricCounter counter, uint32_t n);
+void metricsSetGauge(MetricGauge gauge, uint32_t value);
+
+// Renders everything as Prometheus text, handing it to `emit` in pieces.
+void metricsWrite(void (*emit)(const char* text, size_t len, void* ctx), void* ctx);
+
+#endif // METRICS_H
@@ -0,0 +1,46 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer ring of N - 1 usable slots.
+// push() may only be called from one task and pop() from one other task;
+// neither blocks.
+template <typename T, uint16_t N>
+class SpscQueue {
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    bool push(const T& item) {
+        uint16_t h = head.load(std::memory_order_relaxed);
+        uint16_t next = (h + 1) & (N - 1);
+        if (next == tail.load(std::memory_order_acquire))
+            return false;   // full
+        slots[h] = item;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        uint16_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;   // empty
+        item = slots[t];
+        tail.store((t + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+private:
+    T slots[N];
+    std::atomic<uint16_t> head;   // next slot to write (producer)
+    std::atomic<uint16_t> tail;   // next slot to read (consumer)
+};
+
+#endif // SPSC_QUEUE_H
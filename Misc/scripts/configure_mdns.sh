@@ -1,7 +1,7 @@
 #!/bin/bash
 # mDNS Configuration Script for macOS
 # This script forces the hostname to metallyze-server (advertised as metallyze-server.local)
-# and optionally advertises an HTTP service (e.g., a Flask server) using mDNS.
+# and optionally advertises the backend (Web/server.py) to sensors using mDNS.
 #
 # Note: Changing the hostname requires administrative privileges.
 
@@ -16,21 +16,22 @@ sudo scutil --set HostName "metallyze-server.local"
 echo "Hostname successfully set. Your mDNS name is now metallyze-server.local."
 
 # Optionally advertise an HTTP service via mDNS
-read -p "Do you want to advertise an HTTP service (e.g., a Flask server) via mDNS? (y/n): " ADVERTISE
+read -p "Do you want to advertise the Metallyze backend to sensors via mDNS? (y/n): " ADVERTISE
 
 if [[ "$ADVERTISE" =~ ^[Yy]$ ]]; then
-    SERVICE_NAME="My Flask Server"
-    SERVICE_TYPE="_http._tcp"
+    # Sensors look for this service type; the TXT record gives the upload path.
+    SERVICE_NAME="metallyze-server"
+    SERVICE_TYPE="_metallyze._tcp"
     DEFAULT_PORT=80
 
-    read -p "Enter the port for the HTTP service (default ${DEFAULT_PORT}): " SERVICE_PORT
+    read -p "Enter the port the backend listens on (default ${DEFAULT_PORT}): " SERVICE_PORT
     if [ -z "$SERVICE_PORT" ]; then
       SERVICE_PORT=$DEFAULT_PORT
     fi
 
     echo "Advertising '$SERVICE_NAME' on metallyze-server.local (port ${SERVICE_PORT})..."
     # The dns-sd command will advertise the service until terminated.
-    dns-sd -R "$SERVICE_NAME" "$SERVICE_TYPE" local $SERVICE_PORT &
+    dns-sd -R "$SERVICE_NAME" "$SERVICE_TYPE" local $SERVICE_PORT path=/upload &
     ADVERT_PID=$!
     echo "Service advertisement started with PID: $ADVERT_PID."
     echo "To stop the advertisement later, run: kill $ADVERT_PID"
@@ -4,6 +4,10 @@ import os
 from datetime import datetime
 import numpy as np
 import io
+import json
+import socket
+import struct
+import threading
 
 app = Flask(__name__)
 CORS(app)  # Enable CORS if needed
@@ -19,6 +23,55 @@ latest_current = []              # Current data (in µA) from the latest CSV mes
 line1_slope = 0.03
 line1_intercept = 1.0
 
+# Binary voltammogram uploads (SWVB, see FW/src/device/voltammogram_format.h)
+SWVB_CONTENT_TYPE = "application/vnd.metallyze.swvb"
+SWVB_HEADER = struct.Struct("<4sBBHhhhBBIIfff")
+
+def read_zigzag_varint(buf, pos):
+    result = 0
+    shift = 0
+    while True:
+        byte = buf[pos]
+        pos += 1
+        result |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            break
+        shift += 7
+    return (result >> 1) ^ -(result & 1), pos
+
+def decode_swvb(buf):
+    """Decode an SWVB payload into its front-end channel and the CSV columns
+    [Index, Current_uA, Voltage_V, Time_ms]."""
+    (magic, version, gain, num_points, start_v, step_v, pulse_amp, channel, _reserved,
+     half_period_us, current_lsb_pa, a_coeff, b_coeff, tia_gain) = SWVB_HEADER.unpack_from(buf, 0)
+    # Version 1 is the same layout with the channel byte reserved (0).
+    if magic != b"SWVB" or version not in (1, 2):
+        raise ValueError(f"unsupported voltammogram format {magic!r} v{version}")
+
+    data_arr = np.zeros((num_points, 4))
+    pos = SWVB_HEADER.size
+    voltage_mv = start_v
+    time_us = 0
+    for i in range(num_points):
+        dv, pos = read_zigzag_varint(buf, pos)
+        current, pos = read_zigzag_varint(buf, pos)
+        dt, pos = read_zigzag_varint(buf, pos)
+        voltage_mv += dv + step_v
+        time_us += dt + 2 * half_period_us
+        data_arr[i] = (i, current * current_lsb_pa * 1e-6, voltage_mv / 1000.0, time_us / 1000.0)
+
+    # Time is reported relative to the first point, as in the CSV export.
+    if num_points:
+        data_arr[:, 3] -= data_arr[0, 3]
+    return channel, data_arr
+
+def to_csv(data_arr):
+    out = io.StringIO()
+    out.write("Index,Current_uA,Voltage_V,Time_ms\n")
+    for index, current, voltage, time_ms in data_arr:
+        out.write(f"{int(index)},{current:.10f},{voltage:.3f},{time_ms:.3f}\n")
+    return out.getvalue()
+
 # Serve the website (index.html must be in the "templates" folder)
 @app.route('/')
 def index():
@@ -39,14 +92,41 @@ def data():
 # Endpoint to receive CSV data from the ESP
 @app.route('/upload', methods=['POST'])
 def upload():
+    if request.mimetype == "application/json":
+        process_summary(json.loads(request.data))
+    else:
+        process_payload(request.data, request.mimetype == SWVB_CONTENT_TYPE)
+    return "Data received", 200
+
+# Record a peak/concentration summary computed on the device (no curve).
+# Fields: sweepId, channel, points, peakV, peakUa, baselineUa, heightUa, concentration, flags.
+def process_summary(summary):
+    global current_concentration, concentration_history, time_history
+
+    current_concentration = summary["concentration"]
+    print(f"Received summary of sweep {summary['sweepId']} (channel {summary.get('channel', 0)}): "
+          f"peak {summary['peakUa']} µA "
+          f"at {summary['peakV']} V, concentration {current_concentration}, flags {summary['flags']:#04x}")
+
+    concentration_history.append(current_concentration)
+    time_history.append(datetime.now().strftime("%H:%M:%S"))
+
+# Decode one voltammogram (CSV or SWVB) and update the concentration state.
+def process_payload(payload, is_binary):
     global current_concentration, concentration_history, time_history, latest_voltage, latest_current
 
-    csv_data = request.data.decode('utf-8')
-    print("Received CSV data:")
-    print(csv_data)
+    channel = 0
+    if is_binary:
+        channel, data_arr = decode_swvb(payload)
+        csv_data = to_csv(data_arr)
+        print(f"Received binary voltammogram: {len(payload)} bytes, {len(data_arr)} points, channel {channel}")
+    else:
+        csv_data = payload.decode('utf-8')
+        print("Received CSV data:")
+        print(csv_data)
 
-    # Parse CSV data (skip header row)
-    data_arr = np.genfromtxt(io.StringIO(csv_data), delimiter=',', skip_header=1)
+        # Parse CSV data (skip header row)
+        data_arr = np.genfromtxt(io.StringIO(csv_data), delimiter=',', skip_header=1)
 
     # Data columns: [Index, Current_uA, Voltage_V, Time_ms]
     current_values = data_arr[:, 1]
@@ -82,13 +162,67 @@ def upload():
     output_dir = "out"
     os.makedirs(output_dir, exist_ok=True)
     timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
-    filename = os.path.join(output_dir, f"{timestamp}.csv")
+    # Channels of one sweep arrive within the same second.
+    filename = os.path.join(output_dir, f"{timestamp}_ch{channel}.csv")
     with open(filename, "w") as f:
         f.write(csv_data)
     print(f"Data saved to {filename}")
 
-    return "Data received", 200
+# Receive sweeps broadcast by the ESP as UDP datagram sets:
+# "SWVU", sequence (uint32), chunk index (uint16), chunk count (uint16), data.
+UDP_PORT = 5005
+UDP_HEADER = struct.Struct("<4sIHH")
+
+def udp_listener():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", UDP_PORT))
+    sequence, chunks = None, {}
+    while True:
+        datagram, _ = sock.recvfrom(2048)
+        if len(datagram) < UDP_HEADER.size:
+            continue
+        magic, seq, index, count = UDP_HEADER.unpack_from(datagram, 0)
+        if magic != b"SWVU":
+            continue
+        if seq != sequence:
+            sequence, chunks = seq, {}
+        chunks[index] = datagram[UDP_HEADER.size:]
+        if len(chunks) == count:
+            payload = b"".join(chunks[i] for i in range(count))
+            chunks = {}
+            try:
+                if payload[:1] == b"{":
+                    process_summary(json.loads(payload))
+                else:
+                    process_payload(payload, payload[:4] == b"SWVB")
+            except Exception as e:
+                print(f"Dropped UDP sweep {seq}: {e}")
+
+def advertise(port, path="/upload"):
+    """Advertise this server as a _metallyze._tcp service so sensors find it over mDNS."""
+    try:
+        from zeroconf import ServiceInfo, Zeroconf
+    except ImportError:
+        print("zeroconf not installed; sensors only find this server through their access point")
+        return None
+    # The address of the interface that routes to the sensor's access point.
+    probe = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        probe.connect(("192.168.4.1", 80))
+        address = probe.getsockname()[0]
+    finally:
+        probe.close()
+    info = ServiceInfo("_metallyze._tcp.local.",
+                       f"{socket.gethostname()}._metallyze._tcp.local.",
+                       addresses=[socket.inet_aton(address)], port=port,
+                       properties={"path": path})
+    zc = Zeroconf()
+    zc.register_service(info)
+    return zc
 
 if __name__ == '__main__':
+    threading.Thread(target=udp_listener, daemon=True).start()
+    zeroconf = advertise(80)   # keeps the advertisement alive
     # Run the Flask app on all interfaces at port 80.
     app.run(host='0.0.0.0', port=80)